@@ -0,0 +1,232 @@
+#pragma once
+
+/// Opt-in measurement of the time vector spends in allocate_at_least and deallocate, per allocator type. Enable it by defining
+/// P2667_ALLOCATION_LATENCY in all translation units, otherwise vector uses empty stand-ins and no code is generated.
+///
+/// Each call is timed with the time stamp counter on x86 and steady_clock elsewhere, and counted in a log-linear histogram
+/// (16 sub-buckets per power of two, so about 6 % resolution) per allocator type, operation and thread. The histograms of
+/// all threads are summed when allocation_latency_report() is called, or at exit if the environment variable
+/// P2667_ALLOCATION_LATENCY names a file.
+
+#include "demangle.h"
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <forward_list>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define P2667_LATENCY_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define P2667_LATENCY_TSC
+#endif
+
+namespace std {
+namespace detail {
+
+enum class __allocation_op { allocate_at_least, deallocate, count };
+
+
+inline uint64_t __latency_ticks() {
+#ifdef P2667_LATENCY_TSC
+    return __rdtsc();
+#else
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+// HDR style histogram: Values below 32 have a bucket each, above that each power of two is split in 16 buckets.
+struct __latency_histogram {
+    static constexpr int sub_bits = 4;
+    static constexpr size_t bucket_count = (64 - sub_bits + 1) << sub_bits;
+
+    static size_t index_of(uint64_t value) {
+        if (value < (2 << sub_bits))
+            return size_t(value);
+
+        int shift = bit_width(value) - (sub_bits + 1);
+        return (size_t(shift) << sub_bits) + size_t(value >> shift);
+    }
+
+    // The highest value which is counted in the bucket.
+    static uint64_t value_of(size_t index) {
+        if (index < (2 << sub_bits))
+            return index;
+
+        int shift = int(index >> sub_bits) - 1;
+        uint64_t top = (index & ((1 << sub_bits) - 1)) + (1 << sub_bits);
+        return ((top + 1) << shift) - 1;
+    }
+
+    // Only written by the owning thread, so relaxed load and store instead of read-modify-write.
+    void add(uint64_t value) {
+        atomic<uint64_t>& bucket = buckets[index_of(value)];
+        bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    atomic<uint64_t> buckets[bucket_count] = {};
+};
+
+
+struct __latency_summary {
+    uint64_t counts[__latency_histogram::bucket_count] = {};
+
+    void add(const __latency_histogram& histogram) {
+        for (size_t i = 0; i < __latency_histogram::bucket_count; i++)
+            counts[i] += histogram.buckets[i].load(memory_order_relaxed);
+    }
+
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint64_t count : counts)
+            sum += count;
+        return sum;
+    }
+
+    uint64_t percentile(double fraction) const {
+        uint64_t target = uint64_t(fraction * total());
+        uint64_t seen = 0;
+        for (size_t i = 0; i < __latency_histogram::bucket_count; i++) {
+            seen += counts[i];
+            if (counts[i] != 0 && seen >= target)
+                return __latency_histogram::value_of(i);
+        }
+        return 0;
+    }
+};
+
+
+struct __thread_latency {
+    type_index allocator;
+    __latency_histogram histograms[size_t(__allocation_op::count)];
+};
+
+
+// All threads' histograms. Never destroyed as vectors may be destroyed during program exit.
+class __latency_registry {
+public:
+    static __latency_registry& instance() {
+        static __latency_registry& registry = *new __latency_registry;
+        return registry;
+    }
+
+    void add(__thread_latency* histograms, const char* name) {
+        lock_guard<mutex> lock(m_mutex);
+        m_threads.push_front(histograms);
+        m_names.try_emplace(histograms->allocator, __demangle(name));
+    }
+
+    void remove(__thread_latency* histograms) {
+        lock_guard<mutex> lock(m_mutex);
+        auto& retired = m_retired[histograms->allocator];
+        for (size_t op = 0; op < size_t(__allocation_op::count); op++)
+            retired[op].add(histograms->histograms[op]);
+        m_threads.remove(histograms);
+    }
+
+    void report(ostream& out) {
+        lock_guard<mutex> lock(m_mutex);
+        map<type_index, __latency_summary[size_t(__allocation_op::count)]> summaries;
+        for (auto& [type, retired] : m_retired) {
+            for (size_t op = 0; op < size_t(__allocation_op::count); op++)
+                summaries[type][op] = retired[op];
+        }
+        for (__thread_latency* histograms : m_threads) {
+            for (size_t op = 0; op < size_t(__allocation_op::count); op++)
+                summaries[histograms->allocator][op].add(histograms->histograms[op]);
+        }
+
+        static const char* const op_names[] = { "allocate_at_least", "deallocate" };
+        double ns_per_tick = nanoseconds_per_tick();
+        out << "# allocator\toperation\tcalls\tp50_ns\tp99_ns\tp999_ns\tmax_ns\n";
+        for (auto& [type, summary] : summaries) {
+            for (size_t op = 0; op < size_t(__allocation_op::count); op++) {
+                if (summary[op].total() == 0)
+                    continue;
+
+                out << m_names[type] << '\t' << op_names[op] << '\t' << summary[op].total() << '\t'
+                    << uint64_t(summary[op].percentile(0.5) * ns_per_tick) << '\t'
+                    << uint64_t(summary[op].percentile(0.99) * ns_per_tick) << '\t'
+                    << uint64_t(summary[op].percentile(0.999) * ns_per_tick) << '\t'
+                    << uint64_t(summary[op].percentile(1.0) * ns_per_tick) << '\n';
+            }
+        }
+    }
+
+private:
+    __latency_registry() : m_startTicks(__latency_ticks()), m_startTime(chrono::steady_clock::now()) {}
+
+    // The time stamp counter rate is calibrated against steady_clock over the life time of the registry.
+    double nanoseconds_per_tick() const {
+#ifdef P2667_LATENCY_TSC
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - m_startTime;
+        uint64_t ticks = __latency_ticks() - m_startTicks;
+        return ticks == 0 ? 1.0 : elapsed.count() / ticks;
+#else
+        return 1.0;
+#endif
+    }
+
+    mutex m_mutex;
+    forward_list<__thread_latency*> m_threads;
+    map<type_index, string> m_names;
+    map<type_index, __latency_summary[size_t(__allocation_op::count)]> m_retired;
+    uint64_t m_startTicks;
+    chrono::steady_clock::time_point m_startTime;
+};
+
+
+template<typename Alloc> struct __thread_latency_for : __thread_latency {
+    __thread_latency_for() : __thread_latency{ typeid(Alloc) } { __latency_registry::instance().add(this, typeid(Alloc).name()); }
+    ~__thread_latency_for() { __latency_registry::instance().remove(this); }
+};
+
+// Function local as GCC skips the dynamic initialization of thread_local variable templates.
+template<typename Alloc> __thread_latency& __tls_latency() {
+    static thread_local __thread_latency_for<Alloc> histograms;
+    return histograms;
+}
+
+
+// Times the enclosing scope.
+template<typename Alloc> class __latency_scope {
+public:
+    explicit __latency_scope(__allocation_op op) : m_op(op), m_start(__latency_ticks()) {}
+    ~__latency_scope() { __tls_latency<Alloc>().histograms[size_t(m_op)].add(__latency_ticks() - m_start); }
+
+private:
+    __allocation_op m_op;
+    uint64_t m_start;
+};
+
+
+struct __latency_report_at_exit {
+    ~__latency_report_at_exit() {
+        if (const char* path = getenv("P2667_ALLOCATION_LATENCY")) {
+            ofstream out(path);
+            __latency_registry::instance().report(out);
+        }
+    }
+};
+
+inline __latency_report_at_exit __latency_report_at_exit_instance;
+
+}  // namespace detail
+
+
+// One tab separated line per allocator type and operation with p50, p99, p99.9 and max latency in nanoseconds.
+inline void allocation_latency_report(ostream& out) { detail::__latency_registry::instance().report(out); }
+
+}  // namespace std
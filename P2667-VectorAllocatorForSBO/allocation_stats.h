@@ -0,0 +1,252 @@
+#pragma once
+
+/// Allocator adaptor which collects allocation statistics, intended to be used as the Backing allocator of buffered_allocator
+/// to find out how often sbo_vectors spill out of their buffers. Counters are kept per thread and only summed up when a
+/// snapshot is taken. The live byte count needed for the peak is also kept per thread, and only added to the shared count
+/// once it has changed by __stats_live_batch bytes, so the peak is approximate: It can be off by that much per thread.
+///
+/// Statistics are collected per Tag type, so different vector types can be told apart by giving them different tags.
+
+#include "experimental_memory.h"
+
+#include <atomic>
+#include <forward_list>
+#include <mutex>
+#include <utility>
+
+namespace std {
+
+struct allocation_stats {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t bytes_allocated = 0;
+    size_t bytes_deallocated = 0;
+    size_t spills = 0;              // Allocations made while the allocator had no live block: For a Backing these leave the buffer.
+    size_t slack_bytes = 0;         // Bytes allocate_at_least returned in excess of the request. The unused capacity of the
+                                    // vectors is not known to their allocators, see capacity_profiler.h for that.
+    size_t peak_bytes = 0;          // Peak of bytes_allocated - bytes_deallocated over all threads, see above.
+
+    size_t live_bytes() const { return bytes_allocated - bytes_deallocated; }
+
+    // Difference between two snapshots, to get the statistics for a phase of the program. The peak is the later one.
+    friend allocation_stats operator-(const allocation_stats& lhs, const allocation_stats& rhs) {
+        return { lhs.allocations - rhs.allocations, lhs.deallocations - rhs.deallocations, lhs.bytes_allocated - rhs.bytes_allocated,
+                 lhs.bytes_deallocated - rhs.bytes_deallocated, lhs.spills - rhs.spills, lhs.slack_bytes - rhs.slack_bytes, lhs.peak_bytes };
+    }
+};
+
+
+namespace detail {
+
+// Change of a thread's live bytes which is added to the shared live byte count, at which the peak is checked.
+constexpr ptrdiff_t __stats_live_batch = 64 * 1024;
+
+// Counters of one thread. Only the owning thread writes them, so a relaxed load and store is enough and avoids locked
+// instructions, while the snapshot can still read them safely from another thread.
+struct __thread_stats_counters {
+    atomic<size_t> allocations{};
+    atomic<size_t> deallocations{};
+    atomic<size_t> bytes_allocated{};
+    atomic<size_t> bytes_deallocated{};
+    atomic<size_t> spills{};
+    atomic<size_t> slack_bytes{};
+    atomic<ptrdiff_t> pending_live_bytes{};          // Not yet added to the shared live byte count.
+
+    static void add(atomic<size_t>& counter, size_t value) {
+        counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+    }
+
+    void add_to(allocation_stats& stats) const {
+        stats.allocations += allocations.load(memory_order_relaxed);
+        stats.deallocations += deallocations.load(memory_order_relaxed);
+        stats.bytes_allocated += bytes_allocated.load(memory_order_relaxed);
+        stats.bytes_deallocated += bytes_deallocated.load(memory_order_relaxed);
+        stats.spills += spills.load(memory_order_relaxed);
+        stats.slack_bytes += slack_bytes.load(memory_order_relaxed);
+    }
+};
+
+
+// All threads' counters for a Tag. Never destroyed, as threads may deallocate during program exit.
+template<typename Tag> class __stats_registry {
+public:
+    static __stats_registry& instance() {
+        static __stats_registry& registry = *new __stats_registry;
+        return registry;
+    }
+
+    void add(__thread_stats_counters* counters) {
+        lock_guard<mutex> lock(m_mutex);
+        m_threads.push_front(counters);
+    }
+
+    // Fold the counters of an exiting thread into the retired totals.
+    void remove(__thread_stats_counters* counters) {
+        add_live(counters->pending_live_bytes.exchange(0, memory_order_relaxed));
+        lock_guard<mutex> lock(m_mutex);
+        counters->add_to(m_retired);
+        m_threads.remove(counters);
+    }
+
+    // Called by the owning thread, which only touches the shared counts once per __stats_live_batch bytes.
+    void add_live(__thread_stats_counters& counters, ptrdiff_t bytes) {
+        ptrdiff_t pending = counters.pending_live_bytes.load(memory_order_relaxed) + bytes;
+        if (pending < __stats_live_batch && pending > -__stats_live_batch) {
+            counters.pending_live_bytes.store(pending, memory_order_relaxed);
+            return;
+        }
+
+        counters.pending_live_bytes.store(0, memory_order_relaxed);
+        add_live(pending);
+    }
+
+    void add_live(ptrdiff_t bytes) {
+        ptrdiff_t live = m_liveBytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+        ptrdiff_t peak = m_peakBytes.load(memory_order_relaxed);
+        while (live > peak && !m_peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed))
+            ;
+    }
+
+    allocation_stats snapshot() {
+        lock_guard<mutex> lock(m_mutex);
+        allocation_stats stats = m_retired;
+        ptrdiff_t live = m_liveBytes.load(memory_order_relaxed);
+        for (__thread_stats_counters* counters : m_threads) {
+            counters->add_to(stats);
+            live += counters->pending_live_bytes.load(memory_order_relaxed);
+        }
+
+        // Live bytes the threads have not added yet can make for a peak they did not see.
+        ptrdiff_t peak = m_peakBytes.load(memory_order_relaxed);
+        while (live > peak && !m_peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed))
+            ;
+
+        stats.peak_bytes = size_t(max(peak, live));
+        return stats;
+    }
+
+private:
+    mutex m_mutex;
+    forward_list<__thread_stats_counters*> m_threads;
+    allocation_stats m_retired;
+    atomic<ptrdiff_t> m_liveBytes{};
+    atomic<ptrdiff_t> m_peakBytes{};
+};
+
+
+template<typename Tag> struct __thread_stats : __thread_stats_counters {
+    __thread_stats() { __stats_registry<Tag>::instance().add(this); }
+    ~__thread_stats() { __stats_registry<Tag>::instance().remove(this); }
+};
+
+// A function local thread_local rather than a variable template, as GCC skips the dynamic initialization of thread_local
+// variable templates.
+template<typename Tag> __thread_stats<Tag>& __tls_stats() {
+    static thread_local __thread_stats<Tag> stats;
+    return stats;
+}
+
+}  // namespace detail
+
+
+// Sum of the statistics of all threads that used stats_allocators with this Tag.
+template<typename Tag = void> allocation_stats allocation_statistics() {
+    return detail::__stats_registry<Tag>::instance().snapshot();
+}
+
+
+// Adaptor which counts the allocations made through Alloc and forwards everything else, including the allocator_info traits.
+// The number of live blocks is kept per allocator object, which is what lets it detect spills when used as Backing, as
+// buffered_allocator only calls its backing allocator when the vector outgrows the buffer.
+template<typename Alloc, typename Tag = void> class stats_allocator {
+    using Traits = allocator_traits<Alloc>;
+public:
+    using value_type = Traits::value_type;
+    using pointer = Traits::pointer;
+    using const_pointer = Traits::const_pointer;
+    using void_pointer = Traits::void_pointer;
+    using const_void_pointer = Traits::const_void_pointer;
+    using difference_type = Traits::difference_type;
+    using size_type = Traits::size_type;
+
+    struct propagate_on_container_copy_assignment : Traits::propagate_on_container_copy_assignment {};
+    struct propagate_on_container_move_assignment : Traits::propagate_on_container_move_assignment {};
+    struct propagate_on_container_swap : Traits::propagate_on_container_swap {};
+    using is_always_equal = Traits::is_always_equal;
+
+    static constexpr size_type buffer_capacity = allocator_info::buffer_capacity<Alloc>;
+    static constexpr bool can_allocate = allocator_info::can_allocate<Alloc>;
+    static constexpr bool deallocate_is_noop = allocator_info::deallocate_is_noop<Alloc>;
+
+    template<typename U> struct rebind {
+        using other = stats_allocator<typename Traits::template rebind_alloc<U>, Tag>;
+    };
+
+    template<typename... Args> requires is_constructible_v<Alloc, Args...>
+        stats_allocator(Args&&... args) : m_alloc(forward<Args>(args)...) {}
+    template<typename A> stats_allocator(const stats_allocator<A, Tag>& src) : m_alloc(src.m_alloc) {}
+
+    // The live block count follows the blocks, so it moves but is not copied.
+    stats_allocator(const stats_allocator& src) : m_alloc(src.m_alloc) {}
+    stats_allocator(stats_allocator&& src) : m_alloc(move(src.m_alloc)), m_liveBlocks(exchange(src.m_liveBlocks, 0)) {}
+    stats_allocator& operator=(const stats_allocator& src) {
+        m_alloc = src.m_alloc;
+        return *this;
+    }
+    stats_allocator& operator=(stats_allocator&& src) {
+        m_alloc = move(src.m_alloc);
+        m_liveBlocks = exchange(src.m_liveBlocks, 0);
+        return *this;
+    }
+
+    pointer allocate(size_type count) {
+        pointer p = Traits::allocate(m_alloc, count);
+        record_allocate(count, count);
+        return p;
+    }
+
+    allocation_result<pointer> allocate_at_least(size_type count) {
+        auto result = allocator_info::allocate_at_least(m_alloc, count);
+        record_allocate(count, result.count);
+        return { result.ptr, result.count };
+    }
+
+    void deallocate(pointer p, size_type count) {
+        Traits::deallocate(m_alloc, p, count);
+
+        auto& stats = detail::__tls_stats<Tag>();
+        stats.add(stats.deallocations, 1);
+        stats.add(stats.bytes_deallocated, count * sizeof(value_type));
+        detail::__stats_registry<Tag>::instance().add_live(stats, -ptrdiff_t(count * sizeof(value_type)));
+        m_liveBlocks--;
+    }
+
+    constexpr size_type max_size() const { return Traits::max_size(m_alloc); }
+
+    stats_allocator select_on_container_copy_construction() const {
+        return stats_allocator(Traits::select_on_container_copy_construction(m_alloc));
+    }
+
+    const Alloc& inner_allocator() const { return m_alloc; }
+
+    template<typename A> friend bool operator==(const stats_allocator& lhs, const stats_allocator<A, Tag>& rhs) { return lhs.m_alloc == rhs.m_alloc; }
+
+private:
+    template<typename A, typename T> friend class stats_allocator;
+
+    void record_allocate(size_type requested, size_type granted) {
+        auto& stats = detail::__tls_stats<Tag>();
+        stats.add(stats.allocations, 1);
+        stats.add(stats.bytes_allocated, granted * sizeof(value_type));
+        stats.add(stats.slack_bytes, (granted - requested) * sizeof(value_type));
+        if (m_liveBlocks++ == 0)
+            stats.add(stats.spills, 1);
+
+        detail::__stats_registry<Tag>::instance().add_live(stats, ptrdiff_t(granted * sizeof(value_type)));
+    }
+
+    [[no_unique_address]] Alloc m_alloc;
+    ptrdiff_t m_liveBlocks = 0;
+};
+
+}  // namespace std
@@ -0,0 +1,214 @@
+#pragma once
+
+/// Minimal benchmark harness for the bench_* programs, writing one JSON object per program run. It doesn't use any
+/// container, so it can be used both with the vector of this demo and with the standard library's.
+///
+/// Each benchmark body runs a batch of operations and returns how many it did, timing only the operations themselves with
+/// the stopwatch it gets, so that setup and teardown are not counted. The batch size is doubled until a batch takes at least
+/// the minimum time, or the batch including setup takes 25 times that, then the batch is repeated and the median and
+/// minimum time per operation reported.
+///
+/// Where Linux perf events are available the stopwatch also counts cycles, instructions, branch misses and L1D and LLC
+/// misses while it runs, and their averages per operation over all repetitions are reported next to the times.
+
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace bench {
+
+// Keep the compiler from optimizing away a value or the stores to the memory it points to.
+template<typename T> inline void do_not_optimize(T&& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+
+class stopwatch {
+public:
+    explicit stopwatch(perf_counters& counters) : m_counters(counters) {}
+
+    void start() {
+        m_counters.enable();
+        m_start = std::chrono::steady_clock::now();
+    }
+    void stop() {
+        m_elapsed += std::chrono::steady_clock::now() - m_start;
+        m_counters.disable();
+    }
+
+    double seconds() const { return m_elapsed.count(); }
+
+private:
+    perf_counters& m_counters;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::duration<double> m_elapsed{};
+};
+
+
+struct options {
+    double min_batch_seconds = 0.002;
+    int repetitions = 7;
+    const char* filter = nullptr;      // Only run benchmarks whose name contains one of these comma separated strings.
+    const char* output = nullptr;      // JSON file, stdout if not given.
+    bool perf = true;                   // Read hardware performance counters if possible.
+};
+
+// Usage: <program> [--filter text[,text...]] [--min-time seconds] [--repetitions n] [--out file.json] [--perf on|off]
+inline options parse_options(int argc, char** argv)
+{
+    options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--filter") == 0)
+            opts.filter = argv[i + 1];
+        else if (strcmp(argv[i], "--min-time") == 0)
+            opts.min_batch_seconds = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--repetitions") == 0)
+            opts.repetitions = std::max(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "--out") == 0)
+            opts.output = argv[i + 1];
+        else if (strcmp(argv[i], "--perf") == 0)
+            opts.perf = strcmp(argv[i + 1], "off") != 0;
+    }
+    return opts;
+}
+
+
+class suite {
+public:
+    explicit suite(const options& opts, const char* program) : m_options(opts), m_counters(opts.perf) {
+        m_out = opts.output ? std::fopen(opts.output, "w") : stdout;
+        if (m_out == nullptr) {
+            std::perror(opts.output);
+            std::exit(1);
+        }
+
+        std::fprintf(m_out, "{\n  \"context\": {\"program\": \"%s\", \"compiler\": \"%s\", \"min_batch_seconds\": %g, \"repetitions\": %d, "
+                     "\"perf_counters\": [", program, compiler(), opts.min_batch_seconds, opts.repetitions);
+        const char* separator = "";
+        for (int c = 0; c < perf_counters::counter_count; c++) {
+            if (m_counters.available(perf_counters::counter(c))) {
+                std::fprintf(m_out, "%s\"%s\"", separator, perf_counters::name(perf_counters::counter(c)));
+                separator = ", ";
+            }
+        }
+        std::fprintf(m_out, "]},\n  \"benchmarks\": [");
+    }
+    ~suite() {
+        std::fprintf(m_out, "\n  ]\n}\n");
+        if (m_out != stdout)
+            std::fclose(m_out);
+    }
+
+    // Body is called as body(batch, stopwatch) and returns the number of operations it did.
+    template<typename Body> void run(const char* container, const char* element, size_t size, const char* operation, Body body) {
+        std::string name = std::string(container) + '/' + element + '/' + std::to_string(size) + '/' + operation;
+        if (!selected(name))
+            return;
+
+        // Fast operations with slow setup, like moving a vector of strings, would otherwise take seconds per batch.
+        size_t batch = 1;
+        for (;;) {
+            auto wall_start = std::chrono::steady_clock::now();
+            double timed = seconds(body, batch).first;
+            std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start;
+            if (timed >= m_options.min_batch_seconds || wall.count() >= 25 * m_options.min_batch_seconds || batch >= (size_t(1) << 30))
+                break;
+
+            batch *= 2;
+        }
+
+        double samples[64];
+        int repetitions = std::min(m_options.repetitions, 64);
+        size_t operations = 0, total_operations = 0;
+        double totals[perf_counters::counter_count] = {};
+        for (int r = 0; r < repetitions; r++) {
+            m_counters.reset();
+            auto [elapsed, ops] = seconds(body, batch);
+            samples[r] = elapsed * 1e9 / double(std::max<size_t>(ops, 1));
+            operations = ops;
+            total_operations += ops;
+
+            double counts[perf_counters::counter_count];
+            m_counters.read(counts);
+            for (int c = 0; c < perf_counters::counter_count; c++)
+                totals[c] = counts[c] < 0 || totals[c] < 0 ? -1 : totals[c] + counts[c];
+        }
+        std::sort(samples, samples + repetitions);
+
+        std::fprintf(m_out, "%s\n    {\"name\": \"%s\", \"container\": \"%s\", \"element\": \"%s\", \"size\": %zu, \"operation\": \"%s\", "
+                     "\"operations\": %zu, \"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f",
+                     m_first ? "" : ",", name.c_str(), container, element, size, operation, operations,
+                     samples[repetitions / 2], samples[0]);
+
+        // Counters are null where they are not available, so that all objects have the same fields.
+        double ops = double(std::max<size_t>(total_operations, 1));
+        for (int c = 0; c < perf_counters::counter_count; c++) {
+            const char* counter_name = perf_counters::name(perf_counters::counter(c));
+            if (totals[c] < 0)
+                std::fprintf(m_out, ", \"%s_per_op\": null", counter_name);
+            else
+                std::fprintf(m_out, ", \"%s_per_op\": %.3f", counter_name, totals[c] / ops);
+        }
+        if (totals[perf_counters::cycles] > 0 && totals[perf_counters::instructions] >= 0)
+            std::fprintf(m_out, ", \"ipc\": %.3f}", totals[perf_counters::instructions] / totals[perf_counters::cycles]);
+        else
+            std::fprintf(m_out, ", \"ipc\": null}");
+        m_first = false;
+        std::fflush(m_out);
+    }
+
+private:
+    bool selected(const std::string& name) const {
+        if (m_options.filter == nullptr)
+            return true;
+
+        for (const char* part = m_options.filter; ; ) {
+            const char* end = std::strchr(part, ',');
+            size_t length = end ? size_t(end - part) : std::strlen(part);
+            if (name.find(std::string(part, length)) != std::string::npos)
+                return true;
+            if (end == nullptr)
+                return false;
+            part = end + 1;
+        }
+    }
+
+    template<typename Body> std::pair<double, size_t> seconds(Body& body, size_t batch) {
+        stopwatch timer(m_counters);
+        size_t ops = body(batch, timer);
+        return { timer.seconds(), ops };
+    }
+
+    static const char* compiler() {
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+#define BENCH_STRINGIFY2(x) #x
+#define BENCH_STRINGIFY(x) BENCH_STRINGIFY2(x)
+        return "msvc " BENCH_STRINGIFY(_MSC_FULL_VER);
+#else
+        return "unknown";
+#endif
+    }
+
+    options m_options;
+    perf_counters m_counters;
+    FILE* m_out;
+    bool m_first = true;
+};
+
+}  // namespace bench
@@ -0,0 +1,64 @@
+// Random-access benchmark for a large lookup vector with the mmap_allocator options. For each configuration the time to
+// reserve the vector is reported, which includes faulting in the pages with populate, the time to fill it, which includes
+// the first-touch page faults without, and the throughput of random lookups, where huge pages save TLB misses.
+//
+// Usage: bench_huge_pages [megabytes] [lookups]
+//
+// Whether huge pages are used depends on /sys/kernel/mm/transparent_hugepage/enabled, which must be madvise or always.
+
+#include "experimental_vector.h"
+#include "mmap_allocator.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+using std::mmap_options;
+
+template<mmap_options Options> void run(const char* name, size_t count, size_t lookups)
+{
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    std::vector<uint64_t, std::mmap_allocator<uint64_t, Options>> table;
+    table.reserve(count);
+    auto reserved = clock::now();
+    for (size_t i = 0; i < count; i++)
+        table.push_back(i * 2654435761u);
+    auto filled = clock::now();
+
+    // xorshift, so that the lookups are not predictable by the prefetcher and cost next to nothing themselves.
+    uint64_t state = 88172645463325252u;
+    uint64_t sum = 0;
+    auto lookup = [&] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        sum += table[state % count];
+    };
+
+    for (size_t i = 0; i < lookups; i++)
+        lookup();
+    auto looked_up = clock::now();
+
+    if (sum == 42)      // Keep the lookups.
+        std::puts("");
+
+    using ms = std::chrono::duration<double, std::milli>;
+    std::printf("%-22s %10.1f %10.1f %12.1f\n", name, ms(reserved - start).count(), ms(filled - reserved).count(),
+                lookups / ms(looked_up - filled).count() / 1e3);
+}
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = argc > 1 ? std::atol(argv[1]) : 1024;
+    size_t count = std::max<size_t>(megabytes, 1) * (1 << 20) / sizeof(uint64_t);
+    size_t lookups = argc > 2 ? std::atol(argv[2]) : 20000000;
+
+    std::printf("%zu MiB, %zu random lookups\n\n", megabytes, lookups);
+    std::printf("%-22s %10s %10s %12s\n", "options", "reserve ms", "fill ms", "lookups M/s");
+    run<mmap_options::none>("none", count, lookups);
+    run<mmap_options::populate>("populate", count, lookups);
+    run<mmap_options::huge_pages>("huge_pages", count, lookups);
+    run<mmap_options::huge_pages | mmap_options::populate>("huge_pages | populate", count, lookups);
+}
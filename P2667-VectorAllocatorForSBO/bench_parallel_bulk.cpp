@@ -0,0 +1,84 @@
+// Scaling benchmark for the parallel bulk operations of parallel_bulk.h, from 1 to N threads: value-initialization of
+// elements with a constructor, value-initialization of numbers, which is a memset, copying of numbers, which is a memcpy,
+// and copying of strings. The throughput is in million elements per second.
+//
+// Usage: bench_parallel_bulk [max_threads] [million_elements]
+
+#include "experimental_vector.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+
+struct pixel {
+    float r = 0.5f, g = 0.5f, b = 0.5f, a = 1.0f;
+};
+
+}  // namespace
+
+template<> struct std::parallel_bulk_threshold<pixel, std::allocator<pixel>> : std::integral_constant<size_t, 65536> {};
+template<> struct std::parallel_bulk_threshold<uint32_t, std::allocator<uint32_t>> : std::integral_constant<size_t, 65536> {};
+template<> struct std::parallel_bulk_threshold<std::string, std::allocator<std::string>> : std::integral_constant<size_t, 16384> {};
+
+namespace {
+
+// The destination is allocated and faulted in beforehand, as page faults don't scale.
+template<typename T, typename F> double measure(size_t count, F operation)
+{
+    std::vector<T> dest(count);
+    dest.resize(0);
+
+    auto start = std::chrono::steady_clock::now();
+    operation(dest);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (dest.size() != count)
+        std::abort();
+    return count / elapsed.count() / 1e6;
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+    unsigned max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    size_t count = (argc > 2 ? std::atol(argv[2]) : 100) * 1000000;
+    max_threads = std::min(std::max(max_threads, 1u), 64u);
+
+    std::vector<uint32_t> numbers(count);
+    for (size_t i = 0; i < count; i++)
+        numbers[i] = uint32_t(i);
+    size_t string_count = count / 10;
+    std::vector<std::string> strings(string_count);
+    for (size_t i = 0; i < string_count; i++)
+        strings[i] = "a string longer than the short string buffer " + std::to_string(i);
+
+    std::printf("%zu elements, %zu strings\n\n", count, string_count);
+    std::printf("%8s %14s %14s %14s %14s\n", "threads", "construct M/s", "zero M/s", "copy M/s", "strings M/s");
+    double base[4] = {};
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        std::set_parallel_bulk_threads(threads);
+        double rates[4] = {
+            measure<pixel>(count, [&](std::vector<pixel>& v) { v.resize(count); }),
+            measure<uint32_t>(count, [&](std::vector<uint32_t>& v) { v.resize(count); }),
+            measure<uint32_t>(count, [&](std::vector<uint32_t>& v) { v = numbers; }),
+            measure<std::string>(string_count, [&](std::vector<std::string>& v) { v = strings; }),
+        };
+        if (threads == 1)
+            std::copy(rates, rates + 4, base);
+
+        std::printf("%8u", threads);
+        for (int i = 0; i < 4; i++)
+            std::printf(" %8.0f %5.2fx", rates[i], rates[i] / base[i]);
+        std::printf("\n");
+
+        if (threads == max_threads)
+            break;
+    }
+}
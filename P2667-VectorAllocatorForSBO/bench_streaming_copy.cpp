@@ -0,0 +1,91 @@
+// Benchmark of vector copies with and without non-temporal stores (see streaming_copy.h). A second thread does random
+// lookups in a hot table which fits in the cache, as the rest of a program would, and its throughput shows how much the
+// copies evict it. Its throughput while nothing is copied is the baseline.
+//
+// Usage: bench_streaming_copy [copy_megabytes] [hot_kilobytes] [copies]
+
+#include "experimental_vector.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+std::atomic<bool> stop{false};
+std::atomic<uint64_t> lookups{0};
+
+void hot_workload(const uint64_t* table, size_t count)
+{
+    uint64_t state = 88172645463325252u;
+    uint64_t sum = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 1024; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            sum += table[state % count];
+        }
+        lookups.fetch_add(1024, std::memory_order_relaxed);
+    }
+    if (sum == 42)      // Keep the lookups.
+        std::puts("");
+}
+
+// Returns the copy throughput in GB/s, or 0 if copies is 0, and the lookups of the hot workload in M/s.
+std::pair<double, double> measure(std::vector<uint64_t>& dest, const std::vector<uint64_t>& src, int copies)
+{
+    uint64_t lookups_before = lookups.load();
+    auto start = clock_type::now();
+    if (copies == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    for (int i = 0; i < copies; i++)
+        dest = src;
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+    double bytes = double(src.size()) * sizeof(uint64_t) * copies;
+    return { bytes / elapsed.count() / 1e9, (lookups.load() - lookups_before) / elapsed.count() / 1e6 };
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = argc > 1 ? std::atol(argv[1]) : 512;
+    size_t hot_kilobytes = argc > 2 ? std::atol(argv[2]) : 4096;
+    int copies = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    std::vector<uint64_t> src(std::max<size_t>(megabytes, 1) * (1 << 20) / sizeof(uint64_t));
+    for (size_t i = 0; i < src.size(); i++)
+        src[i] = i;
+    std::vector<uint64_t> dest(src);        // Fault in the pages of the destination before timing.
+
+    std::vector<uint64_t> hot(std::max<size_t>(hot_kilobytes, 1) * 1024 / sizeof(uint64_t));
+    for (size_t i = 0; i < hot.size(); i++)
+        hot[i] = i;
+    std::thread workload(hot_workload, hot.data(), hot.size());
+
+    std::printf("%zu MiB copies, %zu kB hot table\n\n", megabytes, hot_kilobytes);
+    std::printf("%-12s %10s %16s\n", "copy", "GB/s", "hot lookups M/s");
+
+    auto idle = measure(dest, src, 0);
+    std::printf("%-12s %10s %16.1f\n", "none", "-", idle.second);
+
+    std::set_streaming_copy_threshold(size_t(-1));
+    auto cached = measure(dest, src, copies);
+    std::printf("%-12s %10.2f %16.1f\n", "memcpy", cached.first, cached.second);
+
+    std::set_streaming_copy_threshold(0);
+    auto streamed = measure(dest, src, copies);
+    std::printf("%-12s %10.2f %16.1f\n", "streaming", streamed.first, streamed.second);
+
+    stop = true;
+    workload.join();
+}
@@ -0,0 +1,55 @@
+// Scaling benchmark for sbo_vector spills backed by std::allocator versus thread_caching_allocator. Each thread repeatedly
+// builds vectors which spill out of their inline buffer, and the total throughput is reported for 1 to N threads.
+//
+// Usage: bench_thread_caching [max_threads] [iterations_per_thread]
+
+#include "experimental_vector.h"
+#include "thread_caching_allocator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+template<typename Backing> void spill_loop(size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        std::sbo_vector<int, 16, Backing> v;
+        for (int j = 0; j < 200; j++)      // Grows through several size classes.
+            v.push_back(j);
+
+        if (v[199] != 199)
+            std::abort();
+    }
+}
+
+template<typename Backing> double run(unsigned threads, size_t iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread workers[256];
+    for (unsigned t = 0; t < threads; t++)
+        workers[t] = std::thread(spill_loop<Backing>, iterations);
+    for (unsigned t = 0; t < threads; t++)
+        workers[t].join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return threads * iterations / elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+    unsigned max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    size_t iterations = argc > 2 ? std::atol(argv[2]) : 20000;
+    max_threads = std::min(std::max(max_threads, 1u), 256u);
+
+    std::printf("%8s %18s %18s %8s\n", "threads", "std::allocator/s", "thread_caching/s", "speedup");
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        double plain = run<std::allocator<int>>(threads, iterations);
+        double cached = run<std::thread_caching_allocator<int>>(threads, iterations);
+        std::printf("%8u %18.0f %18.0f %8.2f\n", threads, plain, cached, cached / plain);
+
+        if (threads == max_threads)
+            break;
+    }
+}
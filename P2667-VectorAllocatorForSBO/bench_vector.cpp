@@ -0,0 +1,187 @@
+// Microbenchmarks of the P2667 containers: vector, sbo_vector and static_vector, for a few sizes and element types. Each
+// operation is applied to a whole container of the given size, ns_per_op is the time for that. The results are written
+// as JSON.
+//
+// The vector of this demo replaces std::vector, so the standard library's vector can't be linked into the same program.
+// Compiled with P2667_BENCH_STD_VECTOR this file instead becomes bench_std_vector, which runs the same benchmarks on
+// std::vector from <vector> for comparison.
+//
+// Usage: bench_vector [--filter text[,text...]] [--min-time seconds] [--repetitions n] [--out file.json] [--perf on|off]
+
+#ifdef P2667_BENCH_STD_VECTOR
+#include <vector>
+#else
+#include "experimental_vector.h"
+#endif
+
+#include "bench_harness.h"
+
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace {
+
+struct blob32 {
+    long long values[4];
+};
+
+template<typename T> T element(size_t i);
+template<> int element<int>(size_t i) { return int(i); }
+template<> blob32 element<blob32>(size_t i) { return { { (long long)i, 1, 2, 3 } }; }
+template<> std::string element<std::string>(size_t i) { return "element number " + std::to_string(i) + " of the benchmark"; }   // Too long for the SSO
+
+template<typename C> void fill(C& c, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        c.push_back(element<typename C::value_type>(i));
+}
+
+
+// Run the operation on batch containers, in chunks to keep the memory use down. Only op is timed.
+template<typename C, typename Setup, typename Op> size_t chunked(size_t batch, bench::stopwatch& timer, Setup setup, Op op)
+{
+    constexpr size_t chunk = 256;
+    std::unique_ptr<std::optional<C>[]> items(new std::optional<C>[chunk]);
+    for (size_t done = 0; done < batch; done += chunk) {
+        size_t count = std::min(chunk, batch - done);
+        for (size_t i = 0; i < count; i++)
+            setup(items[i]);
+
+        timer.start();
+        for (size_t i = 0; i < count; i++)
+            op(items[i]);
+        timer.stop();
+
+        for (size_t i = 0; i < count; i++)
+            items[i].reset();
+    }
+
+    return batch;
+}
+
+
+#ifdef P2667_BENCH_STD_VECTOR
+// std::vector can't move its elements to a vector with a different allocator type, so they are moved one by one.
+template<typename T> struct other_allocator : std::allocator<T> {
+    template<typename U> struct rebind {
+        using other = other_allocator<U>;
+    };
+
+    other_allocator() = default;
+    template<typename U> other_allocator(const other_allocator<U>&) {}
+};
+
+template<typename C> using move_target = std::vector<typename C::value_type, other_allocator<typename C::value_type>>;
+template<typename C> move_target<C> move_to_other_allocator(C& src)
+{
+    return move_target<C>(std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+}
+#else
+// Moving between allocators with the same backing allocator is what P2667 adds: A spilled sbo_vector hands its block over
+// to a vector and a vector its block to a sbo_vector if it does not fit the buffer. static_vector has no backing
+// allocator so its elements are moved one by one.
+template<typename C> struct move_target_of {
+    using type = std::vector<typename C::value_type>;
+};
+template<typename T, typename A> struct move_target_of<std::vector<T, A>> {
+    using type = std::sbo_vector<T, 16>;
+};
+
+template<typename C> using move_target = typename move_target_of<C>::type;
+template<typename C> move_target<C> move_to_other_allocator(C& src) { return move_target<C>(std::move(src)); }
+#endif
+
+
+template<typename C> void run_container(bench::suite& suite, const char* container, const char* element_name, size_t size)
+{
+    auto empty = [](std::optional<C>& c) { c.emplace(); };
+    auto filled = [size](std::optional<C>& c) {
+        c.emplace();
+        fill(*c, size);
+    };
+
+    suite.run(container, element_name, size, "push_back", [&](size_t batch, bench::stopwatch& timer) {
+        return chunked<C>(batch, timer, empty, [&](std::optional<C>& c) {
+            fill(*c, size);
+            bench::do_not_optimize(c->data());
+        });
+    });
+
+    suite.run(container, element_name, size, "reserve", [&](size_t batch, bench::stopwatch& timer) {
+        return chunked<C>(batch, timer, empty, [&](std::optional<C>& c) {
+            c->reserve(size);
+            fill(*c, size);
+            bench::do_not_optimize(c->data());
+        });
+    });
+
+    C source;
+    fill(source, size);
+    suite.run(container, element_name, size, "copy", [&](size_t batch, bench::stopwatch& timer) {
+        return chunked<C>(batch, timer, [](std::optional<C>&) {}, [&](std::optional<C>& c) {
+            c.emplace(source);
+            bench::do_not_optimize(c->data());
+        });
+    });
+
+    suite.run(container, element_name, size, "move_between_allocators", [&](size_t batch, bench::stopwatch& timer) {
+        std::unique_ptr<std::optional<move_target<C>>[]> targets(new std::optional<move_target<C>>[256]);
+        size_t next = 0;
+        return chunked<C>(batch, timer, filled, [&](std::optional<C>& c) {
+            targets[next % 256].emplace(move_to_other_allocator(*c));
+            bench::do_not_optimize(targets[next % 256]->data());
+            if (++next % 256 == 0) {
+                timer.stop();
+                for (size_t i = 0; i < 256; i++)
+                    targets[i].reset();
+                timer.start();
+            }
+        });
+    });
+
+    suite.run(container, element_name, size, "clear", [&](size_t batch, bench::stopwatch& timer) {
+        return chunked<C>(batch, timer, filled, [](std::optional<C>& c) {
+            c->clear();
+            bench::do_not_optimize(c->data());
+        });
+    });
+
+    suite.run(container, element_name, size, "destroy", [&](size_t batch, bench::stopwatch& timer) {
+        return chunked<C>(batch, timer, filled, [](std::optional<C>& c) {
+            c.reset();
+            bench::do_not_optimize(c);
+        });
+    });
+}
+
+
+template<typename T> void run_element(bench::suite& suite, const char* element_name)
+{
+    for (size_t size : { 4, 16, 64, 256 }) {
+#ifdef P2667_BENCH_STD_VECTOR
+        run_container<std::vector<T>>(suite, "std::vector", element_name, size);
+#else
+        run_container<std::vector<T>>(suite, "vector", element_name, size);
+        run_container<std::sbo_vector<T, 16>>(suite, "sbo_vector<16>", element_name, size);
+        run_container<std::static_vector<T, 256>>(suite, "static_vector<256>", element_name, size);
+#endif
+    }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+#ifdef P2667_BENCH_STD_VECTOR
+    bench::suite suite(bench::parse_options(argc, argv), "bench_std_vector");
+#else
+    bench::suite suite(bench::parse_options(argc, argv), "bench_vector");
+#endif
+
+    run_element<int>(suite, "int");
+    run_element<blob32>(suite, "blob32");
+    run_element<std::string>(suite, "string");
+}
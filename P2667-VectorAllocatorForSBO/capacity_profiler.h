@@ -0,0 +1,155 @@
+#pragma once
+
+/// Opt-in profiler which records how large vectors get, per vector type and construction site, to help choosing the SZ of
+/// sbo_vector and static_vector. Enable it by defining P2667_PROFILE_CAPACITY in all translation units, then call
+/// capacity_profile_report() or set the environment variable P2667_CAPACITY_PROFILE to a file name to get the report
+/// written at exit.
+///
+/// Each vector stores its construction site and peak size. When it is destroyed its final size, peak size and capacity are
+/// added to the histograms of its site under a mutex, so this is not for release builds. The report has the histograms as
+/// size:count lists, after summary columns.
+
+#include "experimental_memory.h"
+#include "demangle.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+
+namespace std {
+namespace detail {
+
+using __call_site = source_location;
+
+
+struct __capacity_site_stats {
+    string type_name;
+    size_t element_size = 0;
+    size_t buffer_capacity = 0;
+    size_t vectors = 0;
+    size_t final_size_sum = 0;
+    size_t max_capacity = 0;
+    map<size_t, size_t> final_sizes;
+    map<size_t, size_t> peak_sizes;       // Exact histogram, as the recommendation is a percentile of this.
+    map<size_t, size_t> capacities;       // Capacity at destruction, which is the peak capacity unless shrink_to_fit was called.
+};
+
+
+class __capacity_registry {
+public:
+    // Never destroyed, vectors with static storage duration may be destroyed after the report is written.
+    static __capacity_registry& instance() {
+        static __capacity_registry& registry = *new __capacity_registry;
+        return registry;
+    }
+
+    void record(const type_info& type, size_t element_size, size_t buffer_capacity, const source_location& where,
+                size_t final_size, size_t peak_size, size_t capacity) {
+        lock_guard<mutex> lock(m_mutex);
+        __capacity_site_stats& site = m_sites[key(where.file_name(), where.line(), where.column(), type_index(type))];
+        if (site.vectors++ == 0) {
+            site.type_name = __demangle(type.name());
+            site.element_size = element_size;
+            site.buffer_capacity = buffer_capacity;
+        }
+
+        site.final_size_sum += final_size;
+        site.max_capacity = max(site.max_capacity, capacity);
+        site.final_sizes[final_size]++;
+        site.peak_sizes[peak_size]++;
+        site.capacities[capacity]++;
+    }
+
+    // The smallest SZ which would have kept the given fraction of the vectors of the site within their buffer.
+    static size_t recommended_capacity(const __capacity_site_stats& site, double percentile) {
+        size_t covered = 0;
+        for (auto [size, count] : site.peak_sizes) {
+            covered += count;
+            if (covered >= percentile * site.vectors)
+                return size;
+        }
+
+        return site.peak_sizes.empty() ? 0 : site.peak_sizes.rbegin()->first;
+    }
+
+    void report(ostream& out, double percentile) {
+        lock_guard<mutex> lock(m_mutex);
+        out << "# site\ttype\tvectors\telement_size\tcurrent_SZ\tmean_final_size\tmax_peak_size\tmax_capacity\trecommended_SZ"
+               "\tfinal_sizes\tpeak_sizes\tcapacities\n";
+        for (auto& [where, site] : m_sites) {
+            out << get<0>(where) << ':' << get<1>(where) << ':' << get<2>(where) << '\t' << site.type_name << '\t' << site.vectors
+                << '\t' << site.element_size << '\t' << site.buffer_capacity << '\t' << double(site.final_size_sum) / site.vectors
+                << '\t' << site.peak_sizes.rbegin()->first << '\t' << site.max_capacity << '\t'
+                << recommended_capacity(site, percentile) << '\t';
+            write_histogram(out, site.final_sizes);
+            out << '\t';
+            write_histogram(out, site.peak_sizes);
+            out << '\t';
+            write_histogram(out, site.capacities);
+            out << '\n';
+        }
+    }
+
+private:
+    using key = tuple<string, uint_least32_t, uint_least32_t, type_index>;
+
+    static void write_histogram(ostream& out, const map<size_t, size_t>& histogram) {
+        const char* separator = "";
+        for (auto [size, count] : histogram) {
+            out << separator << size << ':' << count;
+            separator = ",";
+        }
+    }
+
+    mutex m_mutex;
+    map<key, __capacity_site_stats> m_sites;
+};
+
+
+template<typename Vector> class __capacity_profile {
+public:
+    __capacity_profile(source_location where) : m_where(where) {}
+
+    void note_size(size_t size) { m_peakSize = max(m_peakSize, size); }
+
+    void record(size_t size, size_t capacity) {
+        using Alloc = typename Vector::allocator_type;
+        __capacity_registry::instance().record(typeid(Vector), sizeof(typename Vector::value_type), allocator_info::buffer_capacity<Alloc>,
+                                               m_where, size, max(m_peakSize, size), capacity);
+    }
+
+private:
+    source_location m_where;
+    size_t m_peakSize = 0;
+};
+
+
+struct __capacity_report_at_exit {
+    ~__capacity_report_at_exit() {
+        if (const char* path = getenv("P2667_CAPACITY_PROFILE")) {
+            ofstream out(path);
+            __capacity_registry::instance().report(out, 0.95);
+        }
+    }
+};
+
+inline __capacity_report_at_exit __capacity_report_at_exit_instance;
+
+}  // namespace detail
+
+
+// Write one tab separated line per vector type and construction site. The recommended SZ is the smallest one which would have
+// kept the given fraction of the vectors in their buffer.
+inline void capacity_profile_report(ostream& out, double percentile = 0.95) {
+    detail::__capacity_registry::instance().report(out, percentile);
+}
+
+}  // namespace std
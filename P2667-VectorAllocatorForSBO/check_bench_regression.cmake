@@ -0,0 +1,174 @@
+# Run the benchmarks listed in a baseline file and fail if any got slower than the baseline by more than its tolerance.
+# Needs CMake 3.19 for string(JSON).
+#
+#   cmake -DBENCH=path/to/bench_vector -DBASELINE=bench_baseline.json -DOUTPUT=current.json -P check_bench_regression.cmake
+#
+# The minimum time per operation is compared, as it is the least noisy, and benchmarks that are over their limit are
+# run again up to RETRIES times (default 4) keeping the best time, so that a single disturbed run doesn't fail the test.
+# Each baseline entry can have a "tolerance_percent", otherwise the default_tolerance_percent of the file applies.
+# The default of 100% in bench_baseline.json is what repeated runs of an unchanged tree needed to pass on the shared
+# single core VM it was recorded on, whose speed drifts by a third between runs; lower it on a quiet machine.
+#
+# Baselines are only valid for the machine and compiler they were recorded with, which are kept in the baseline file and
+# warned about when they differ. To record a new baseline on the gating machine, with the benchmark list and tolerances
+# kept, build bench_vector in a Release or RelWithDebInfo build of this directory and add -DUPDATE=ON. The baseline is the
+# median of the best times of RUNS runs (default 5), so that a fast spell of the machine doesn't set it too low:
+#
+#   cmake -S . -B build -DCMAKE_BUILD_TYPE=RelWithDebInfo && cmake --build build --target bench_vector
+#   cmake -DBENCH=build/bench_vector -DBASELINE=bench_baseline.json -DOUTPUT=build/bench_vector.json -DUPDATE=ON -P check_bench_regression.cmake
+
+cmake_minimum_required(VERSION 3.19)
+
+if (NOT DEFINED RETRIES)
+    set(RETRIES 4)
+endif()
+if (NOT DEFINED RUNS)
+    set(RUNS 5)
+endif()
+
+# math() only does integers, so compare picoseconds. string(JSON) gives the numbers back with all digits of a double.
+function(to_picoseconds ns out)
+    string(REGEX MATCH "^([0-9]+)\\.?([0-9]*)" ignored "${ns}")
+    string(SUBSTRING "${CMAKE_MATCH_2}000" 0 3 fraction)
+    math(EXPR ps "${CMAKE_MATCH_1} * 1000 + 1${fraction} - 1000")
+    set(${out} ${ps} PARENT_SCOPE)
+endfunction()
+
+function(to_nanoseconds ps out)
+    math(EXPR whole "${ps} / 1000")
+    math(EXPR fraction "${ps} % 1000 + 1000")
+    string(SUBSTRING ${fraction} 1 3 fraction)
+    set(${out} "${whole}.${fraction}" PARENT_SCOPE)
+endfunction()
+
+# Run the named benchmarks and lower current_<index>, the best time in picoseconds of the baseline entry index. The time of
+# each run is also appended to runs_<index>.
+macro(run_benchmarks run_names)
+    list(JOIN ${run_names} "," filter)
+    execute_process(COMMAND ${BENCH} --filter ${filter} --perf off --repetitions 11 --out ${OUTPUT} RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${BENCH} failed: ${result}")
+    endif()
+
+    file(READ ${OUTPUT} current)
+    string(JSON current_compiler GET "${current}" context compiler)
+    string(JSON current_count LENGTH "${current}" benchmarks)
+    math(EXPR current_last "${current_count} - 1")
+    foreach (j RANGE ${current_last})
+        string(JSON name GET "${current}" benchmarks ${j} name)
+        string(JSON time GET "${current}" benchmarks ${j} ns_per_op_min)
+        list(FIND names ${name} index)
+        if (NOT index EQUAL -1)
+            to_picoseconds(${time} ps)
+            list(APPEND runs_${index} ${ps})
+            if (NOT DEFINED current_${index} OR ps LESS current_${index})
+                set(current_${index} ${ps})
+            endif()
+        endif()
+    endforeach()
+endmacro()
+
+
+cmake_host_system_information(RESULT host QUERY PROCESSOR_DESCRIPTION OS_NAME OS_RELEASE)
+list(GET host 0 cpu)
+list(GET host 1 os)
+list(GET host 2 os_release)
+string(STRIP "${cpu}" cpu)
+set(current_machine "${cpu}, ${os} ${os_release}")
+
+file(READ ${BASELINE} baseline)
+string(JSON default_tolerance GET "${baseline}" default_tolerance_percent)
+string(JSON baseline_compiler GET "${baseline}" compiler)
+string(JSON baseline_machine ERROR_VARIABLE no_machine GET "${baseline}" machine)
+string(JSON count LENGTH "${baseline}" benchmarks)
+math(EXPR last "${count} - 1")
+
+set(names "")
+foreach (i RANGE ${last})
+    string(JSON name GET "${baseline}" benchmarks ${i} name)
+    list(APPEND names ${name})
+endforeach()
+
+run_benchmarks(names)
+if (UPDATE)
+    foreach (run RANGE 2 ${RUNS})
+        run_benchmarks(names)
+    endforeach()
+else()
+    if (NOT current_compiler STREQUAL baseline_compiler)
+        message(WARNING "Baseline was recorded with ${baseline_compiler}, this is ${current_compiler}")
+    endif()
+    if (NOT current_machine STREQUAL baseline_machine)
+        message(WARNING "Baseline was recorded on ${baseline_machine}, this is ${current_machine}")
+    endif()
+endif()
+
+if (UPDATE)
+    set(updated "")
+    foreach (i RANGE ${last})
+        list(GET names ${i} name)
+        if (NOT DEFINED current_${i})
+            message(FATAL_ERROR "${name}: missing from the results")
+        endif()
+
+        list(SORT runs_${i} COMPARE NATURAL)
+        list(LENGTH runs_${i} run_count)
+        math(EXPR middle "${run_count} / 2")
+        list(GET runs_${i} ${middle} median)
+        to_nanoseconds(${median} time)
+        string(JSON tolerance ERROR_VARIABLE no_tolerance GET "${baseline}" benchmarks ${i} tolerance_percent)
+        if (no_tolerance)
+            string(APPEND updated ",\n    {\"name\": \"${name}\", \"ns_per_op_min\": ${time}}")
+        else()
+            string(APPEND updated ",\n    {\"name\": \"${name}\", \"ns_per_op_min\": ${time}, \"tolerance_percent\": ${tolerance}}")
+        endif()
+    endforeach()
+
+    string(SUBSTRING "${updated}" 1 -1 updated)
+    file(WRITE ${BASELINE} "{\n  \"compiler\": \"${current_compiler}\",\n  \"machine\": \"${current_machine}\",\n  \"default_tolerance_percent\": ${default_tolerance},\n  \"benchmarks\": [${updated}\n  ]\n}\n")
+    message(STATUS "Updated ${BASELINE}")
+    return()
+endif()
+
+foreach (attempt RANGE ${RETRIES})
+    set(regressions "")
+    set(regressed_names "")
+    foreach (i RANGE ${last})
+        list(GET names ${i} name)
+        if (NOT DEFINED current_${i})
+            list(APPEND regressions "${name}: missing from the results")
+            continue()
+        endif()
+
+        string(JSON base_time GET "${baseline}" benchmarks ${i} ns_per_op_min)
+        string(JSON tolerance ERROR_VARIABLE no_tolerance GET "${baseline}" benchmarks ${i} tolerance_percent)
+        if (no_tolerance)
+            set(tolerance ${default_tolerance})
+        endif()
+
+        to_picoseconds(${base_time} base_ps)
+        to_nanoseconds(${base_ps} base_time)
+        to_nanoseconds(${current_${i}} time)
+        math(EXPR limit_ps "${base_ps} * (100 + ${tolerance}) / 100")
+        math(EXPR percent "${current_${i}} * 100 / ${base_ps} - 100")
+        if (current_${i} GREATER limit_ps)
+            list(APPEND regressions "${name}: ${time} ns is ${percent}% slower than the baseline ${base_time} ns, limit ${tolerance}%")
+            list(APPEND regressed_names ${name})
+        elseif (attempt EQUAL 0)
+            message(STATUS "${name}: ${time} ns, baseline ${base_time} ns (${percent}%, limit +${tolerance}%)")
+        endif()
+    endforeach()
+
+    if (NOT regressed_names OR attempt EQUAL RETRIES)
+        break()
+    endif()
+
+    list(LENGTH regressed_names retry_count)
+    message(STATUS "Running ${retry_count} benchmarks over their limit again")
+    run_benchmarks(regressed_names)
+endforeach()
+
+if (regressions)
+    list(JOIN regressions "\n  " report)
+    message(FATAL_ERROR "Performance regressions:\n  ${report}")
+endif()
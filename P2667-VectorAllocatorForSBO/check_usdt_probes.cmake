@@ -0,0 +1,18 @@
+# Check that the p2667 USDT probes, with semaphores, are in the notes of BINARY. Run with cmake -DREADELF=... -DBINARY=... -P check_usdt_probes.cmake
+execute_process(COMMAND ${READELF} -n ${BINARY} OUTPUT_VARIABLE notes RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${READELF} -n ${BINARY} failed")
+endif()
+
+foreach (probe vector_reserve buffer_inline buffer_spill buffer_deallocate)
+    string(REGEX MATCH "Provider: p2667[ \t\r\n]+Name: ${probe}" found "${notes}")
+    if (NOT found)
+        message(FATAL_ERROR "USDT probe p2667:${probe} missing from ${BINARY}")
+    endif()
+
+    # Every site of the probe must have its semaphore, or it would evaluate its arguments with nothing attached.
+    string(REGEX MATCHALL "Name: ${probe}[ \t\r\n]+Location: [^\n]*Semaphore: 0x[0]*[\n]" unguarded "${notes}")
+    if (unguarded)
+        message(FATAL_ERROR "USDT probe p2667:${probe} in ${BINARY} has no semaphore")
+    endif()
+endforeach()
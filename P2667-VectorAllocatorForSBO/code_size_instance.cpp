@@ -0,0 +1,29 @@
+// One vector instantiation for the code size matrix of measure_code_size.cmake, selected with
+//
+//   -DP2667_T=<element type> -DP2667_SZ=<buffer size, 0 for vector without buffer> -DP2667_BACKING=<allocator template>
+//
+// Without P2667_T nothing is instantiated, which gives the size of what the headers alone put into an object file.
+
+#include "experimental_vector.h"
+#include "thread_caching_allocator.h"
+
+#include <string>
+
+namespace code_size {
+
+struct blob32 {
+    long long values[4];
+};
+
+}  // namespace code_size
+
+#ifdef P2667_T
+using namespace std;
+using namespace code_size;
+
+#if P2667_SZ == 0
+template class std::vector<P2667_T, P2667_BACKING<P2667_T>>;
+#else
+template class std::vector<P2667_T, std::buffered_allocator<P2667_T, P2667_SZ, P2667_BACKING<P2667_T>>>;
+#endif
+#endif
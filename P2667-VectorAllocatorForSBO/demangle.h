@@ -0,0 +1,26 @@
+#pragma once
+
+/// Readable type names for the profiling reports.
+
+#include <cstdlib>
+#include <string>
+
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#endif
+
+namespace std::detail {
+
+inline string __demangle(const char* name) {
+#if __has_include(<cxxabi.h>)
+    int status = 0;
+    if (char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status)) {
+        string result = demangled;
+        free(demangled);
+        return result;
+    }
+#endif
+    return name;        // MSVC names are already readable.
+}
+
+}  // namespace std::detail
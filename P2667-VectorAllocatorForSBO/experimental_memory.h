@@ -3,7 +3,24 @@
 /// This file contains additions to the <memory> header proposed in P2667. In addition to this it is proposed to
 /// move the allocate_at_least function here, but for the moment it forwards to std::
 
+#include "usdt_probes.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <new>
+
+// <memory_resource> includes <vector> in the major implementations, which would clash with the vector of this demo. Use
+// the internal header which only defines memory_resource and polymorphic_allocator where there is one. It is included here
+// as all translation units must agree on how polymorphic_allocator allocates for vector.
+#if __has_include(<xpolymorphic_allocator.h>)
+#include <xpolymorphic_allocator.h>
+#define P2667_HAS_PMR
+#elif __has_include(<bits/memory_resource.h>)
+#include <bits/memory_resource.h>
+#define P2667_HAS_PMR
+#endif
 
 namespace std {
 
@@ -29,11 +46,74 @@ constexpr allocation_result<typename allocator_traits<_Alloc>::pointer> allocate
     }
 }
 
+#ifdef P2667_HAS_PMR
+namespace detail {
+
+// Changed whenever a sized_memory_resource is constructed or destroyed.
+inline atomic<size_t> __sized_resource_generation = 0;
+
+}  // namespace detail
+
+
+namespace pmr {
+
+// Base class for memory resources which can report how many bytes they actually allocated.
+class sized_memory_resource : public memory_resource {
+public:
+    sized_memory_resource() { detail::__sized_resource_generation.fetch_add(1, memory_order_relaxed); }
+    sized_memory_resource(const sized_memory_resource&) : sized_memory_resource() {}
+    ~sized_memory_resource() override { detail::__sized_resource_generation.fetch_add(1, memory_order_relaxed); }
+
+    allocation_result<void*> allocate_at_least(size_t bytes, size_t alignment = alignof(max_align_t)) {
+        return do_allocate_at_least(bytes, alignment);
+    }
+
+protected:
+    virtual allocation_result<void*> do_allocate_at_least(size_t bytes, size_t alignment) = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override { return do_allocate_at_least(bytes, alignment).ptr; }
+};
+
+
+// Allocate from resource, using allocate_at_least if it is a sized_memory_resource. Each thread remembers if the last two
+// resources it saw were, two so that a resource and its upstream resource both fit, and vectors growing in a loop don't pay
+// for a dynamic_cast each time. What is remembered is dropped when any sized_memory_resource is constructed or destroyed, as
+// a new resource may have the address of an old one.
+inline allocation_result<void*> allocate_at_least(memory_resource* resource, size_t bytes, size_t alignment) {
+    struct known_resource {
+        memory_resource* resource = nullptr;
+        sized_memory_resource* sized = nullptr;
+    };
+    thread_local known_resource known[2];
+    thread_local size_t known_generation = 0;
+
+    size_t generation = detail::__sized_resource_generation.load(memory_order_relaxed);
+    if (generation != known_generation) {
+        known[0] = known[1] = {};
+        known_generation = generation;
+    }
+
+    if (known[0].resource != resource) {
+        if (known[1].resource != resource)
+            known[1] = { resource, dynamic_cast<sized_memory_resource*>(resource) };
+        swap(known[0], known[1]);
+    }
+
+    if (known[0].sized != nullptr)
+        return known[0].sized->allocate_at_least(bytes, alignment);
+
+    return { resource->allocate(bytes, alignment), bytes };
+}
+
+}  // namespace pmr
+#endif
+
+
 namespace allocator_info {
 namespace detail {
 
     // Handle that some Alloc's don't have these values
-    template<typename Alloc> constexpr typename Alloc::size_type __get_buffer_capacity() {
+    template<typename Alloc> constexpr typename allocator_traits<Alloc>::size_type __get_buffer_capacity() {
         if constexpr ( requires { Alloc::buffer_capacity; })
             return Alloc::buffer_capacity;
         else
@@ -49,6 +129,14 @@ namespace detail {
             return true;
     }
 
+    // Handle that some Alloc's don't have these values
+    template<typename Alloc> constexpr bool __get_deallocate_is_noop() {
+        if constexpr ( requires { Alloc::deallocate_is_noop; })
+            return Alloc::deallocate_is_noop;
+        else
+            return false;
+    }
+
 }  // namespace detail
 
 
@@ -58,11 +146,71 @@ template<typename Alloc> struct backing_allocator_of {
 
 template<typename Alloc> using backing_allocator_of_t = backing_allocator_of<Alloc>::type;
 
-template<typename Alloc> constexpr typename Alloc::size_type buffer_capacity = detail::__get_buffer_capacity<Alloc>();
+template<typename Alloc> constexpr typename allocator_traits<Alloc>::size_type buffer_capacity = detail::__get_buffer_capacity<Alloc>();
 template<typename Alloc> constexpr bool can_allocate = detail::__get_can_allocate<Alloc>();
 
+// If true deallocate does nothing, so containers don't have to call it (or keep track of what to pass to it).
+template<typename Alloc> constexpr bool deallocate_is_noop = detail::__get_deallocate_is_noop<Alloc>();
+
+// True for containers which never get memory from anywhere but their own buffer, like static_vector, for static_assert in
+// code which must not call malloc. This is about the container's storage only, a static_vector<string, 10> allocates when
+// its strings are long.
+template<typename Container> constexpr bool never_allocates = !can_allocate<typename Container::allocator_type>;
+
+// The buffer capacity of a particular allocator object. Allocators whose buffer is not part of the allocator, like
+// arena_ref_allocator, have a buffer_capacity of 0 and report the size of their buffer from dynamic_buffer_capacity().
+template<typename Alloc> constexpr typename allocator_traits<Alloc>::size_type buffer_capacity_of(const Alloc& alloc) {
+    if constexpr (requires { alloc.dynamic_buffer_capacity(); })
+        return alloc.dynamic_buffer_capacity();
+    else
+        return buffer_capacity<Alloc>;
+}
+
+// True if the allocator can resize a block with reallocate(p, old_count, new_count), which returns an allocation_result like
+// allocate_at_least, with the contents moved as if by memcpy. old_count is the count of the last allocation_result for the
+// block. vector uses it instead of allocate, copy and deallocate when the elements are trivially relocatable.
+template<typename Alloc> constexpr bool can_reallocate = requires(Alloc& alloc, typename allocator_traits<Alloc>::pointer p, size_t count) {
+    alloc.reallocate(p, count, count);
+};
+
+template<typename Alloc> auto reallocate(Alloc& alloc, typename allocator_traits<Alloc>::pointer p,
+                                         typename allocator_traits<Alloc>::size_type old_count,
+                                         typename allocator_traits<Alloc>::size_type new_count) {
+    return alloc.reallocate(p, old_count, new_count);
+}
+
+// True if the allocator can hand out zeroed blocks for less than allocating and clearing them costs, for instance as fresh
+// pages from the operating system, with allocate_zeroed(count) returning an allocation_result like allocate_at_least. vector
+// uses it to value-initialize elements whose value-initialized objects are all zero bytes.
+template<typename Alloc> constexpr bool can_allocate_zeroed = requires(Alloc& alloc, size_t count) { alloc.allocate_zeroed(count); };
+
+template<typename Alloc> auto allocate_zeroed(Alloc& alloc, typename allocator_traits<Alloc>::size_type count) {
+    return alloc.allocate_zeroed(count);
+}
+
+// Specialize to provide allocate_at_least for allocator types which can't get a member function, such as
+// pmr::polymorphic_allocator.
+template<typename Alloc> struct allocate_at_least_traits {
+    static auto allocate_at_least(Alloc& allocator, typename allocator_traits<Alloc>::size_type sz) { return std::allocate_at_least(allocator, sz); }
+};
+
+#ifdef P2667_HAS_PMR
+// polymorphic_allocator can't have an allocate_at_least member, so ask the resource instead.
+template<typename T> struct allocate_at_least_traits<pmr::polymorphic_allocator<T>> {
+    static allocation_result<T*> allocate_at_least(pmr::polymorphic_allocator<T>& allocator, size_t count) {
+        if (count > size_t(-1) / sizeof(T))
+            throw bad_array_new_length();
+
+        auto result = pmr::allocate_at_least(allocator.resource(), count * sizeof(T), alignof(T));
+        return { static_cast<T*>(result.ptr), result.count / sizeof(T) };
+    }
+};
+#endif
+
 // Forwarding to std:: namespace version. Hopefully that function is moved here before C++23 is finalized.
-template<typename Alloc> auto allocate_at_least(Alloc& allocator, typename Alloc::size_type sz) { return std::allocate_at_least(allocator, sz); }
+template<typename Alloc> auto allocate_at_least(Alloc& allocator, typename allocator_traits<Alloc>::size_type sz) {
+    return allocate_at_least_traits<Alloc>::allocate_at_least(allocator, sz);
+}
 
 }  // namespace allocator_info
 
@@ -86,6 +234,7 @@ public:
     // New info
     static const size_type buffer_capacity = SZ;
     static constexpr bool can_allocate = allocator_info::can_allocate<Backing>;
+    static constexpr bool deallocate_is_noop = allocator_info::deallocate_is_noop<Backing>;
 
     template<typename U, typename... Args> struct rebind {
         using other = buffered_allocator<U, SZ, typename Traits::template rebind_alloc<U, Args...>>;
@@ -96,15 +245,21 @@ public:
     template<typename... Args> buffered_allocator(Args&&... args) : m_backingAllocator(forward<Args>(args)...) {}
 
     // Construct by move/copy of the source backing allocator if it matches, and T matches.
-    template<size_t SZ> buffered_allocator(const buffered_allocator<T, SZ, Backing>& src) : m_backingAllocator(src.m_backingAllocator) {} 
-    template<size_t SZ> buffered_allocator(buffered_allocator<T, SZ, Backing>&& src) : m_backingAllocator(move(src.m_backingAllocator)) {} 
+    template<size_t SZS> buffered_allocator(const buffered_allocator<T, SZS, Backing>& src) : m_backingAllocator(src.m_backingAllocator) {} 
+    template<size_t SZS> buffered_allocator(buffered_allocator<T, SZS, Backing>&& src) : m_backingAllocator(move(src.m_backingAllocator)) {} 
 
     // Convert to backing allocator at will, as these don't construct from me.
     operator Backing&& () && { return move(m_backingAllocator); }
     operator const Backing& () const & { return m_backingAllocator; }
 
+    // For instance pmr::polymorphic_allocator reverts to the default resource when a container is copied.
+    buffered_allocator select_on_container_copy_construction() const {
+        return buffered_allocator(Traits::select_on_container_copy_construction(m_backingAllocator));
+    }
+
     T* allocate(size_type count) { return reinterpret_cast<T*>(m_data); }
     void deallocate(T* p, size_type count) { 
+        P2667_PROBE4(buffer_deallocate, sizeof(T), count, p == allocate(0), P2667_PROBE_TYPE(buffered_allocator));
         if (p == allocate(0))
             return;
 
@@ -112,27 +267,45 @@ public:
     }
 
     allocation_result<pointer> allocate_at_least(size_type count) {
-        if (count <= SZ)
+        if (count <= SZ) {
+            P2667_PROBE4(buffer_inline, sizeof(T), count, SZ, P2667_PROBE_TYPE(buffered_allocator));
             return { allocate(0), SZ };
-        else
-            return std::allocate_at_least(m_backingAllocator, count);
+        }
+
+        auto result = allocator_info::allocate_at_least(m_backingAllocator, count);
+        P2667_PROBE4(buffer_spill, sizeof(T), count, result.count, P2667_PROBE_TYPE(buffered_allocator));
+        return { result.ptr, result.count };
+    }
+
+    // Only if the backing allocator has it, as clearing the buffer is no cheaper than the vector clearing its elements.
+    allocation_result<pointer> allocate_zeroed(size_type count) requires allocator_info::can_allocate_zeroed<Backing> {
+        if (count <= SZ) {
+            memset(m_data, 0, sizeof(m_data));
+            return { allocate(0), SZ };
+        }
+
+        auto result = allocator_info::allocate_zeroed(m_backingAllocator, count);
+        return { result.ptr, result.count };
     }
     
-    constexpr size_type max_size() { return max(SZ, Traits::max_size()); }       // If the backing allocator returns 0 return SZ.
+    constexpr size_type max_size() const { return max(SZ, Traits::max_size(m_backingAllocator)); }       // If the backing allocator returns 0 return SZ.
 
-    template<class T, class... Args> constexpr void construct(T* p, Args&&... args) {
+    template<class U, class... Args> constexpr void construct(U* p, Args&&... args) {
         Traits::construct(m_backingAllocator, p, forward<Args>(args)...);
     }
     
+    // Elements in the buffer must be destroyed too, it is only deallocate that has to special case the buffer.
     void destroy(T* p) { 
-        if (p != allocate(0))
-            Traits::destroy(m_backingAllocator, p); 
+        Traits::destroy(m_backingAllocator, p); 
     }
 
-    template<size_t SZR, typename Backing> friend bool operator==(const buffered_allocator& lhs, const buffered_allocator<T, SZR, Backing>& rhs) { return lhs.m_backingAllocator == rhs.m_backingAllocator; }
-    template<size_t SZR, typename Backing> friend bool operator==(const buffered_allocator& lhs, const Backing& rhs) { return lhs.m_backingAllocator == rhs; }
+    // Equal if the backing allocators are equal, for pmr this means that the memory resources compare equal.
+    template<size_t SZR> friend bool operator==(const buffered_allocator& lhs, const buffered_allocator<T, SZR, Backing>& rhs) { return lhs.m_backingAllocator == static_cast<const Backing&>(rhs); }
+    friend bool operator==(const buffered_allocator& lhs, const Backing& rhs) { return lhs.m_backingAllocator == rhs; }
 
 private:
+    template<typename U, size_t SZU, typename B> friend class buffered_allocator;
+
     byte m_data[SZ * sizeof(T)];
     [[no_unique_address]] Backing m_backingAllocator;
 };
@@ -148,18 +321,449 @@ template<typename T, size_t SZ, typename Alloc> struct backing_allocator_of<buff
 }  // namespace allocator_info
 
 
+// Memory owned by the caller for buffered_node_allocator, for instance a stack array. Single objects are handed out by
+// bumping a pointer through it, and released blocks are kept on a free list per block size for reuse by objects of the same
+// size. Only a few different block sizes get free lists, which is enough for the node types of one container, and the
+// bookkeeping types some implementations allocate along with them. It must outlive the containers using it.
+class node_arena {
+public:
+    node_arena(void* data, size_t bytes) : m_cur(static_cast<byte*>(data)), m_end(m_cur + bytes), m_begin(m_cur) {}
+    node_arena(const node_arena&) = delete;
+    node_arena& operator=(const node_arena&) = delete;
+
+    // Returns nullptr if there is no room, or no free list for blocks of this size and alignment.
+    void* allocate(size_t bytes, size_t alignment) {
+        free_list* list = find_list(bytes, alignment);
+        if (list == nullptr)
+            return nullptr;
+
+        if (list->head != nullptr) {
+            free_block* block = list->head;
+            list->head = block->next;
+            return block;
+        }
+
+        alignment = max(alignment, alignof(free_block));
+        byte* p = reinterpret_cast<byte*>((reinterpret_cast<uintptr_t>(m_cur) + alignment - 1) & ~(alignment - 1));
+        if (p > m_end || block_size(bytes) > size_t(m_end - p))
+            return nullptr;
+
+        m_cur = p + block_size(bytes);
+        return p;
+    }
+
+    // p must be from allocate with the same bytes and alignment.
+    void deallocate(void* p, size_t bytes, size_t alignment) {
+        free_list* list = find_list(bytes, alignment);
+        free_block* block = static_cast<free_block*>(p);
+        block->next = list->head;
+        list->head = block;
+    }
+
+    bool contains(const void* p) const {
+        const byte* b = static_cast<const byte*>(p);
+        return !less<const byte*>()(b, m_begin) && less<const byte*>()(b, m_end);
+    }
+
+private:
+    struct free_block {
+        free_block* next;
+    };
+    struct free_list {
+        size_t bytes = 0;
+        size_t alignment = 0;
+        free_block* head = nullptr;
+    };
+
+    static size_t block_size(size_t bytes) { return max(bytes, sizeof(free_block)); }
+
+    // Finds the free list for the size and alignment, claiming an unused one if this is the first such block.
+    free_list* find_list(size_t bytes, size_t alignment) {
+        for (free_list& list : m_lists) {
+            if (list.bytes == 0) {
+                list.bytes = bytes;
+                list.alignment = alignment;
+            }
+            if (list.bytes == bytes && list.alignment == alignment)
+                return &list;
+        }
+        return nullptr;
+    }
+
+    byte* m_cur;
+    byte* m_end;
+    byte* m_begin;
+    free_list m_lists[4];
+};
+
+
+// Allocator for node based containers such as list, map and unordered_map, which gets single element allocations from a
+// node_arena of the caller and everything else from the backing allocator. Multi-element allocations (such as the bucket
+// array of unordered_map) always go to the backing allocator.
+//
+// Copies and rebound copies share the arena, so nodes can be released through any of them and they compare equal, as the
+// allocator requirements demand. When containers are moved the nodes stay in the arena, and as the allocators propagate
+// on assignment and swap, nodes always stay with an allocator of their arena. Default constructed or constructed from a
+// Backing allocator there is no arena. buffer_capacity is left at 0 as the vector rules do not apply here.
+template<typename T, typename Backing = allocator<T>> class buffered_node_allocator {
+    using Traits = allocator_traits<Backing>;
+public:
+    using value_type = Traits::value_type;
+    using pointer = Traits::pointer;
+    using const_pointer = Traits::const_pointer;
+    using void_pointer = Traits::void_pointer;
+    using const_void_pointer = Traits::const_void_pointer;
+    using difference_type = Traits::difference_type;
+    using size_type = Traits::size_type;
+
+    using propagate_on_container_copy_assignment = true_type;
+    using propagate_on_container_move_assignment = true_type;
+    using propagate_on_container_swap = true_type;
+    using is_always_equal = false_type;
+
+    static constexpr bool can_allocate = allocator_info::can_allocate<Backing>;
+
+    template<typename U> struct rebind {
+        using other = buffered_node_allocator<U, typename Traits::template rebind_alloc<U>>;
+    };
+
+    buffered_node_allocator() = default;
+    buffered_node_allocator(node_arena& arena, const Backing& backing = Backing()) : m_arena(&arena), m_backingAllocator(backing) {}
+    template<typename A> requires (!is_same_v<remove_cvref_t<A>, buffered_node_allocator> && is_constructible_v<Backing, A>)
+    buffered_node_allocator(A&& backing) : m_backingAllocator(forward<A>(backing)) {}
+    template<typename U, typename B> buffered_node_allocator(const buffered_node_allocator<U, B>& src)
+        : m_arena(src.m_arena), m_backingAllocator(src.m_backingAllocator) {}
+
+    operator const Backing& () const & { return m_backingAllocator; }
+
+    node_arena* arena() const { return m_arena; }
+
+    T* allocate(size_type count) {
+        if (count == 1 && m_arena != nullptr) {
+            if (void* p = m_arena->allocate(sizeof(T), alignof(T)))
+                return static_cast<T*>(p);
+        }
+
+        return Traits::allocate(m_backingAllocator, count);
+    }
+
+    void deallocate(T* p, size_type count) {
+        if (m_arena != nullptr && m_arena->contains(p)) {
+            m_arena->deallocate(p, sizeof(T), alignof(T));
+            return;
+        }
+
+        Traits::deallocate(m_backingAllocator, p, count);
+    }
+
+    constexpr size_type max_size() const { return Traits::max_size(m_backingAllocator); }
+
+    // Also for rebound copies, which must be able to release each other's blocks.
+    template<typename U, typename B> friend bool operator==(const buffered_node_allocator& lhs, const buffered_node_allocator<U, B>& rhs) {
+        return lhs.m_arena == rhs.arena() && lhs.m_backingAllocator == Backing(static_cast<const B&>(rhs));
+    }
+
+private:
+    template<typename U, typename B> friend class buffered_node_allocator;
+
+    node_arena* m_arena = nullptr;
+    [[no_unique_address]] Backing m_backingAllocator;
+};
+
+
+namespace allocator_info {
+
+template<typename T, typename Alloc> struct backing_allocator_of<buffered_node_allocator<T, Alloc>> {
+    using type = backing_allocator_of_t<Alloc>;
+};
+
+}  // namespace allocator_info
+
+
+// Arena which hands out memory by bumping a pointer through a list of chunks. Memory is only given back in bulk: reset()
+// rewinds to the first chunk in O(1) keeping all chunks for reuse, while release() returns the chunks to the heap. To give
+// back only what was allocated after some point, rewind() to a mark() taken there.
+class monotonic_arena {
+    struct chunk;
+public:
+    class marker {
+        friend class monotonic_arena;
+        chunk* m_current;
+        byte* m_cur;
+    };
+
+    explicit monotonic_arena(size_t chunk_size = 4096) : m_nextChunkSize(chunk_size) {}
+    monotonic_arena(const monotonic_arena&) = delete;
+    monotonic_arena& operator=(const monotonic_arena&) = delete;
+    ~monotonic_arena() { release(); }
+
+    void* allocate(size_t bytes, size_t alignment) {
+        // Oversized chunks are made just large enough, so their end need not be aligned and p can be past it.
+        byte* p = align_up(m_cur, alignment);
+        if (m_cur == nullptr || p > m_end || bytes > size_t(m_end - p))
+            p = next_chunk(bytes, alignment);
+
+        m_cur = p + bytes;
+        return p;
+    }
+
+    // Everything allocated from the arena is dead after this, but the chunks are kept.
+    void reset() {
+        m_current = m_first;
+        if (m_current != nullptr) {
+            m_cur = m_current->data();
+            m_end = m_cur + m_current->size;
+        }
+    }
+
+    marker mark() const {
+        marker m;
+        m.m_current = m_current;
+        m.m_cur = m_cur;
+        return m;
+    }
+
+    // Everything allocated since the mark was taken is dead after this, but the chunks are kept.
+    void rewind(const marker& m) {
+        m_current = m.m_current;
+        m_cur = m.m_cur;
+        m_end = m_current != nullptr ? m_current->data() + m_current->size : nullptr;
+    }
+
+    void release() {
+        while (m_first != nullptr) {
+            chunk* c = m_first;
+            m_first = c->next;
+            ::operator delete(c);
+        }
+        m_current = nullptr;
+        m_cur = m_end = nullptr;
+    }
+
+private:
+    struct alignas(max_align_t) chunk {
+        chunk* next;
+        size_t size;
+        byte* data() { return reinterpret_cast<byte*>(this + 1); }
+    };
+
+    static byte* align_up(byte* p, size_t alignment) {
+        return reinterpret_cast<byte*>((reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~(alignment - 1));
+    }
+
+    // Advance to the next kept chunk large enough or insert a new one after the current chunk.
+    byte* next_chunk(size_t bytes, size_t alignment) {
+        size_t needed = bytes + alignment;
+        chunk* c = m_current != nullptr ? m_current->next : m_first;
+        while (c != nullptr && c->size < needed)
+            c = c->next;
+
+        if (c == nullptr) {
+            size_t size = max(m_nextChunkSize, needed);
+            m_nextChunkSize *= 2;
+            c = static_cast<chunk*>(::operator new(sizeof(chunk) + size));
+            c->size = size;
+            if (m_current != nullptr) {
+                c->next = m_current->next;
+                m_current->next = c;
+            }
+            else {
+                c->next = m_first;
+                m_first = c;
+            }
+        }
+
+        m_current = c;
+        m_end = c->data() + c->size;
+        return align_up(c->data(), alignment);
+    }
+
+    chunk* m_first = nullptr;
+    chunk* m_current = nullptr;
+    byte* m_cur = nullptr;
+    byte* m_end = nullptr;
+    size_t m_nextChunkSize;
+};
+
+
+// Allocator which allocates from a monotonic_arena. Use as Backing of buffered_allocator or directly as Alloc of vector.
+// As deallocation is a no-op vector does not have to deallocate its old buffers at all.
+template<typename T> class monotonic_allocator {
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    // Like the pmr allocators the arena sticks with the container.
+    using propagate_on_container_copy_assignment = false_type;
+    using propagate_on_container_move_assignment = false_type;
+    using propagate_on_container_swap = false_type;
+    using is_always_equal = false_type;
+
+    constexpr static bool deallocate_is_noop = true;
+
+    monotonic_allocator(monotonic_arena& arena) : m_arena(&arena) {}
+    template<typename U> monotonic_allocator(const monotonic_allocator<U>& src) : m_arena(&src.arena()) {}
+
+    T* allocate(size_type count) {
+        if (count > max_size())
+            throw bad_array_new_length();
+
+        return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_type) {}
+
+    static constexpr size_type max_size() { return size_type(-1) / sizeof(T); }
+
+    monotonic_arena& arena() const { return *m_arena; }
+
+    friend bool operator==(const monotonic_allocator& lhs, const monotonic_allocator& rhs) { return lhs.m_arena == rhs.m_arena; }
+
+private:
+    monotonic_arena* m_arena;
+};
+
+
+template<typename T, typename Backing> class arena_ref_allocator;
+
+namespace detail {
+template<typename A> constexpr bool __is_arena_ref_allocator = false;
+template<typename T, typename B> constexpr bool __is_arena_ref_allocator<arena_ref_allocator<T, B>> = true;
+}  // namespace detail
+
+
+// Memory owned by the caller for arena_ref_allocator, for instance a stack array whose size is only known at runtime. It is
+// handed to one container at a time, others using it meanwhile get their memory from the backing allocator. It must outlive
+// the containers using it.
+class arena_buffer {
+public:
+    arena_buffer(void* data, size_t bytes) : m_data(static_cast<byte*>(data)), m_bytes(bytes) {}
+    arena_buffer(const arena_buffer&) = delete;
+    arena_buffer& operator=(const arena_buffer&) = delete;
+
+    bool in_use() const { return m_inUse; }
+
+private:
+    template<typename T, typename Backing> friend class arena_ref_allocator;
+
+    // The part of the buffer which is aligned for T, in elements.
+    template<typename T> T* begin() const {
+        return reinterpret_cast<T*>((reinterpret_cast<uintptr_t>(m_data) + alignof(T) - 1) & ~(alignof(T) - 1));
+    }
+    template<typename T> size_t capacity() const {
+        size_t skipped = reinterpret_cast<byte*>(begin<T>()) - m_data;
+        return skipped > m_bytes ? 0 : (m_bytes - skipped) / sizeof(T);
+    }
+
+    byte* m_data;
+    size_t m_bytes;
+    bool m_inUse = false;
+};
+
+
+// Allocator which uses an arena_buffer of the caller before the Backing allocator. As the buffer is not in the allocator,
+// unlike with buffered_allocator, the vector stays small, its buffer size is not a template parameter, and a vector moved to
+// another of the same type hands over its block even if it is in the buffer. buffer_capacity is 0, the size of the buffer is
+// known from allocator_info::buffer_capacity_of().
+//
+// Default constructed or constructed from a Backing allocator there is no buffer. Copies share the buffer, so a copied
+// vector gets its memory from the backing allocator while the original uses the buffer. Only allocators using the same
+// buffer compare equal, as only they can deallocate blocks in it.
+template<typename T, typename Backing = allocator<T>> class arena_ref_allocator {
+    using Traits = allocator_traits<Backing>;
+public:
+    using value_type = T;
+    using size_type = typename Traits::size_type;
+    using difference_type = typename Traits::difference_type;
+
+    struct propagate_on_container_copy_assignment : Traits::propagate_on_container_copy_assignment {};
+    struct propagate_on_container_move_assignment : Traits::propagate_on_container_move_assignment {};
+    struct propagate_on_container_swap : Traits::propagate_on_container_swap {};
+    using is_always_equal = false_type;
+
+    // Vector must keep pointers even if the backing allocator can't allocate, as the buffer size is only known at runtime.
+    static constexpr bool can_allocate = true;
+
+    template<typename U> struct rebind {
+        using other = arena_ref_allocator<U, typename Traits::template rebind_alloc<U>>;
+    };
+
+    arena_ref_allocator() = default;
+    arena_ref_allocator(arena_buffer& buffer, const Backing& backing = Backing()) : m_buffer(&buffer), m_backingAllocator(backing) {}
+    template<typename A> requires (!detail::__is_arena_ref_allocator<remove_cvref_t<A>> && is_constructible_v<Backing, A>)
+    arena_ref_allocator(A&& backing) : m_backingAllocator(forward<A>(backing)) {}
+    template<typename U, typename B> arena_ref_allocator(const arena_ref_allocator<U, B>& src)
+        : m_buffer(src.m_buffer), m_backingAllocator(src.m_backingAllocator) {}
+
+    // Convert to backing allocator at will, as these don't construct from me.
+    operator Backing&& () && { return move(m_backingAllocator); }
+    operator const Backing& () const & { return m_backingAllocator; }
+
+    arena_ref_allocator select_on_container_copy_construction() const {
+        arena_ref_allocator copy(Traits::select_on_container_copy_construction(m_backingAllocator));
+        copy.m_buffer = m_buffer;
+        return copy;
+    }
+
+    size_type dynamic_buffer_capacity() const { return m_buffer != nullptr ? m_buffer->template capacity<T>() : 0; }
+
+    T* allocate(size_type count) { return allocate_at_least(count).ptr; }
+    void deallocate(T* p, size_type count) {
+        if (m_buffer != nullptr && p == m_buffer->template begin<T>()) {
+            m_buffer->m_inUse = false;
+            return;
+        }
+
+        Traits::deallocate(m_backingAllocator, p, count);
+    }
+
+    allocation_result<T*> allocate_at_least(size_type count) {
+        if (m_buffer != nullptr && !m_buffer->m_inUse && count <= dynamic_buffer_capacity()) {
+            m_buffer->m_inUse = true;
+            return { m_buffer->template begin<T>(), dynamic_buffer_capacity() };
+        }
+
+        auto result = allocator_info::allocate_at_least(m_backingAllocator, count);
+        return { result.ptr, result.count };
+    }
+
+    size_type max_size() const { return max(dynamic_buffer_capacity(), Traits::max_size(m_backingAllocator)); }
+
+    friend bool operator==(const arena_ref_allocator& lhs, const arena_ref_allocator& rhs) {
+        return lhs.m_buffer == rhs.m_buffer && lhs.m_backingAllocator == rhs.m_backingAllocator;
+    }
+    friend bool operator==(const arena_ref_allocator& lhs, const Backing& rhs) { return lhs.m_backingAllocator == rhs; }    // For blocks from the backing allocator.
+
+private:
+    template<typename U, typename B> friend class arena_ref_allocator;
+
+    arena_buffer* m_buffer = nullptr;
+    [[no_unique_address]] Backing m_backingAllocator;
+};
+
+
+namespace allocator_info {
+
+template<typename T, typename Alloc> struct backing_allocator_of<arena_ref_allocator<T, Alloc>> {
+    using type = backing_allocator_of_t<Alloc>;
+};
+
+}  // namespace allocator_info
+
+
 template<typename T> struct terminating_allocator {
     using value_type = T;
     using size_type = size_t;
     using difference_type = ptrdiff_t;
 
     constexpr static bool can_allocate = false;
+    constexpr static bool deallocate_is_noop = true;
 
     T* allocate(size_type count) { terminate(); }
     void deallocate(T*, size_type) {}
 
     static constexpr size_type max_size() { return 0; }
-    constexpr bool operator==(const terminating_allocator&) { return true; }
+    constexpr bool operator==(const terminating_allocator&) const { return true; }
 };
 
 
@@ -169,12 +773,13 @@ template<typename T> struct throwing_allocator {
     using difference_type = ptrdiff_t;
 
     constexpr static bool can_allocate = false;
+    constexpr static bool deallocate_is_noop = true;
 
     T* allocate(size_type count) { throw bad_alloc(); }
     void deallocate(T*, size_type) {}
 
     static constexpr size_type max_size() { return 0; }
-    constexpr bool operator==(const throwing_allocator&) { return true; }
+    constexpr bool operator==(const throwing_allocator&) const { return true; }
 };
 
 
@@ -184,12 +789,13 @@ template<typename T> struct unchecked_allocator {
     using difference_type = ptrdiff_t;
 
     constexpr static bool can_allocate = false;
+    constexpr static bool deallocate_is_noop = true;
 
     T* allocate(size_type count) { return nullptr; }
     void deallocate(T*, size_type) {}
 
     static constexpr size_type max_size() { return 0; }
-    constexpr bool operator==(const unchecked_allocator&) { return true; }
+    constexpr bool operator==(const unchecked_allocator&) const { return true; }
 };
 
 
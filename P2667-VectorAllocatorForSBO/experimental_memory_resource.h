@@ -0,0 +1,54 @@
+#pragma once
+
+/// Additions to <memory_resource> which let pmr based code use buffered_allocator and the allocate_at_least protocol. A
+/// pmr::polymorphic_allocator works as Backing of buffered_allocator as is. The way for memory resources to report the actual
+/// size of the blocks they return, sized_memory_resource, is in experimental_memory.h as vector relies on it. This adds a
+/// resource with an inline buffer.
+
+#include "experimental_memory.h"
+
+#ifndef P2667_HAS_PMR
+#error "No header defining only memory_resource and polymorphic_allocator, and <memory_resource> clashes with this vector"
+#endif
+
+namespace std {
+namespace pmr {
+
+// The memory resource counterpart of buffered_allocator: The whole internal buffer of SZ bytes is handed out to a request
+// that fits while it is unused, other requests go to the upstream resource. As vector gets the full buffer size from
+// allocate_at_least it stays in the buffer until it outgrows it, just as with buffered_allocator.
+template<size_t SZ> class buffered_resource : public sized_memory_resource {
+public:
+    explicit buffered_resource(memory_resource* upstream = get_default_resource()) : m_upstream(upstream) {}
+    buffered_resource(const buffered_resource&) = delete;
+    buffered_resource& operator=(const buffered_resource&) = delete;
+
+    memory_resource* upstream_resource() const { return m_upstream; }
+
+protected:
+    allocation_result<void*> do_allocate_at_least(size_t bytes, size_t alignment) override {
+        if (!m_inUse && bytes <= SZ && alignment <= alignof(max_align_t)) {
+            m_inUse = true;
+            return { m_data, SZ };
+        }
+
+        return pmr::allocate_at_least(m_upstream, bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (p == m_data)
+            m_inUse = false;
+        else
+            m_upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    alignas(max_align_t) byte m_data[SZ];
+    bool m_inUse = false;
+    memory_resource* m_upstream;
+};
+
+}  // namespace pmr
+}  // namespace std
@@ -2,12 +2,81 @@
 
 // Include memory and the new traits in the 
 #include "experimental_memory.h"
+#include "parallel_bulk.h"
+#include "streaming_copy.h"
 
+#include <cstring>
 #include <type_traits>
 #include <tuple>
 
+// Define P2667_PROFILE_CAPACITY in all translation units to record the sizes vectors reach per construction site.
+#ifdef P2667_PROFILE_CAPACITY
+#include "capacity_profiler.h"
+#else
+namespace std::detail {
+
+// Stand-ins for the profiler in capacity_profiler.h. The call site parameter of vector's constructors is empty and unused.
+struct __call_site {
+    static constexpr __call_site current() noexcept { return {}; }
+};
+
+template<typename Vector> struct __capacity_profile {
+    constexpr __capacity_profile(__call_site) {}
+    void note_size(size_t) {}
+    void record(size_t, size_t) {}
+};
+
+}  // namespace std::detail
+#endif
+
+// Define P2667_ALLOCATION_LATENCY in all translation units to get latency histograms of vector's calls to its allocator.
+#ifdef P2667_ALLOCATION_LATENCY
+#include "allocation_latency.h"
+#else
+namespace std::detail {
+
+enum class __allocation_op { allocate_at_least, deallocate };
+
+// Stand-in for the timer in allocation_latency.h.
+template<typename Alloc> struct __latency_scope {
+    constexpr explicit __latency_scope(__allocation_op) {}
+};
+
+}  // namespace std::detail
+#endif
+
+// Define P2667_TRACE_VECTORS in all translation units to record vector operations for replay_vector_trace.
+#ifdef P2667_TRACE_VECTORS
+#include "vector_trace.h"
+#else
+#include "vector_trace_format.h"
+
+namespace std::detail {
+
+// Stand-in for the recorder in vector_trace.h. The destructor of scope keeps the unused scopes from being warned about.
+struct __vector_trace {
+    struct scope {
+        constexpr ~scope() {}
+    };
+    constexpr scope record(__trace_op, uint64_t = 0) { return {}; }
+    constexpr uint64_t id() const { return 0; }
+};
+
+}  // namespace std::detail
+#endif
+
 namespace std {
 
+// Specialize for types whose value-initialized objects are all zero bytes, to let vector value-initialize them by clearing
+// memory or getting it from allocate_zeroed.
+template<typename T> struct is_zero_representable : bool_constant<is_arithmetic_v<T> || is_enum_v<T> || is_pointer_v<T>> {};
+
+// Specialize for the T and Alloc of a vector type to construct, copy and relocate the elements of its vectors on the thread
+// pool of parallel_bulk.h when there are at least value of them. 0, the default, keeps them on the calling thread. The
+// constructors of T and the construct and destroy of Alloc must be safe to call concurrently on different elements.
+template<typename T, typename Alloc> struct parallel_bulk_threshold : integral_constant<size_t, 0> {};
+
+
 namespace detail {
 template<size_t SZ> auto __get_uint_holding()
 {
@@ -27,7 +96,7 @@ template<size_t SZ> using uint_holding = decltype(detail::__get_uint_holding<SZ>
 
 // For static vectors (!can_allocate) just one int of appropriate size.
 template<typename T, size_t SZ> struct vector_storage {
-    uint_holding<SZ> m_size;
+    uint_holding<SZ> m_size = 0;
 };
 
 // The semantics and layout here is the same as in older vector implementation of the same std library implementation to
@@ -38,15 +107,88 @@ template<typename T> struct vector_storage<T, 0> {
     T* m_capacity = nullptr;
 };
 
+
+// True if vector may move and copy its elements with memcpy: T must be trivially copyable and the allocator must not customize
+// construct or destroy. Allocators with a backing allocator forward construct and destroy to it, as buffered_allocator does,
+// so it is the backing allocator that is checked. std::allocator has a construct member in some implementations, but
+// allocator_traits doesn't call it.
+template<typename T, typename Alloc> constexpr bool __get_trivially_relocatable() {
+    using Backing = allocator_info::backing_allocator_of_t<Alloc>;
+    if constexpr (!is_trivially_copyable_v<T>)
+        return false;
+    else if constexpr (is_same_v<Backing, allocator<typename Backing::value_type>>)
+        return true;
+    else
+        return !requires(Backing& a, T* p) { a.construct(p, declval<const T&>()); } && !requires(Backing& a, T* p) { a.destroy(p); };
+}
+
+template<typename T, typename Alloc> constexpr bool __trivially_relocatable = __get_trivially_relocatable<T, Alloc>();
+
+
+// True if value-initializing elements can be done by zeroing their bytes, so that vector can get them from allocate_zeroed.
+// The elements must be trivially relocatable as construct is not called.
+template<typename T, typename Alloc> constexpr bool __zero_initializable = is_zero_representable<T>::value && __trivially_relocatable<T, Alloc>;
+
+
+// Growth of vectors of trivially relocatable elements only depends on the size of the elements, so it is done here by
+// functions which are not templates and thus shared by all such vector instantiations, however many element types and
+// buffer sizes a program uses. The allocator is reached through function pointers to small functions of each vector type.
+struct __raw_block {
+    void* begin;
+    size_t size;
+    size_t capacity;
+};
+
+struct __raw_allocator {
+    void* vector;
+    allocation_result<void*> (*allocate_at_least)(void* vector, size_t count);
+    void (*deallocate)(void* vector);       // Deallocates the current block of the vector, nullptr if deallocate is a no-op.
+    allocation_result<void*> (*reallocate)(void* vector, size_t count);     // Resizes the current block, nullptr if the allocator can't.
+    void (*bulk_copy)(void* dest, const void* src, size_t bytes);      // __bulk_copy if the vector type copies in parallel.
+    size_t parallel_bytes;                  // From how many bytes to use bulk_copy.
+};
+
+// Move the elements of block to a new block of at least capacity elements, deallocating block, and return the new block. The
+// old block is only deallocated after the elements have been moved, so it is left as it was if allocation throws.
+inline __raw_block __grow_trivially_relocatable(const __raw_block& block, size_t capacity, size_t element_size,
+                                                const __raw_allocator& alloc) {
+    if (block.begin != nullptr && alloc.reallocate != nullptr) {
+        allocation_result<void*> result = alloc.reallocate(alloc.vector, capacity);
+        return { result.ptr, block.size, result.count };
+    }
+
+    allocation_result<void*> result = alloc.allocate_at_least(alloc.vector, capacity);
+    size_t bytes = block.size * element_size;
+    if (alloc.bulk_copy != nullptr && bytes >= alloc.parallel_bytes)
+        alloc.bulk_copy(result.ptr, block.begin, bytes);
+    else
+        __copy_elements(result.ptr, block.begin, bytes);
+
+    if (block.begin != nullptr && alloc.deallocate != nullptr)
+        alloc.deallocate(alloc.vector);
+
+    return { result.ptr, block.size, result.count };
+}
+
 }  // namespace detail
 
 
+// Elements and the block they are in, as handed over by vector::release() and to vector::adopt(). The block was allocated by
+// an allocator of type Backing, which can deallocate it with the capacity as count.
+template<typename T, typename Backing> struct vector_block {
+    T* ptr;
+    size_t size;
+    size_t capacity;
+};
+
+
 // Stripped down vector with just a few methods, but which shows what needs to be done in vector to implement P2667
 template<typename T, typename Alloc = allocator<T>> class vector {
 public:
     using value_type = T;
+    using allocator_type = Alloc;
     using size_type = size_t;
-    template<typename T, typename > friend class vector;
+    template<typename U, typename > friend class vector;
 
 private:
     static const size_type buffer_capacity = allocator_info::buffer_capacity<Alloc>;
@@ -55,7 +197,8 @@ private:
     using Backing = allocator_info::backing_allocator_of_t<Alloc>;
 
 public:
-    vector() {
+    vector(detail::__call_site where = detail::__call_site::current()) : m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::create, sizeof(T));
         if constexpr (can_allocate) {
             m_storage.m_begin = nullptr;
             m_storage.m_end = nullptr;
@@ -64,45 +207,89 @@ public:
         else
             m_storage.m_size = 0;
     }
-
-    template<typename A> vector(vector<T, A>&& src) {   // operator= works the same but definitely has to handle propagate_on_container_move_assignment
-        using BA = allocator_info::backing_allocator_of_t<A>;
-        if constexpr (is_same_v<Backing, BA> && allocator_info::can_allocate<A>) {
-            if (src.capacity() > allocator_info::buffer_capacity<A> || src.size() > buffer_capacity) { // src has allocated, and I would have to allocate
-                m_alloc = std::move(src.m_alloc);   // Unclear if this should be conditioned on propagate_on_container_move_assignment in move ctor.
-
-                // move three pointers here, clear source's pointers.
-                m_storage = move(src.m_storage);
-                src.m_storage.m_begin = nullptr;
-                src.m_storage.m_end = nullptr;
-                src.m_storage.m_capacity = nullptr;
-                return;
-            }
+    explicit vector(const Alloc& alloc, detail::__call_site where = detail::__call_site::current()) : m_alloc(alloc), m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::create, sizeof(T));
+        if constexpr (can_allocate) {
+            m_storage.m_begin = nullptr;
+            m_storage.m_end = nullptr;
+            m_storage.m_capacity = nullptr;
         }
+        else
+            m_storage.m_size = 0;
+    }
 
-        take_elements(src.data(), src.size());
-        src.clear();   // Always leave source empty even if it had to be copied.
+    // Value-initialized elements, see resize.
+    explicit vector(size_type count, const Alloc& alloc = Alloc(), detail::__call_site where = detail::__call_site::current())
+        : vector(alloc, where) {
+        resize(count);
     }
-    template<typename A> vector(const vector<T, A>& src) {
+
+    template<typename A> vector(vector<T, A>&& src, detail::__call_site where = detail::__call_site::current()) : m_alloc(allocator_from(std::move(src.m_alloc))), m_profile(where) {   // operator= works the same but definitely has to handle propagate_on_container_move_assignment
+        auto traced = m_trace.record(detail::__trace_op::move_construct, src.m_trace.id());
+        move_from(src);
+    }
+    template<typename A> vector(const vector<T, A>& src, detail::__call_site where = detail::__call_site::current()) : m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::copy_construct, src.m_trace.id());
         copy_elements(src.data(), src.size());
     }
 
-    ~vector() { destroy_me(); }
+    // The implicit copy and move would copy the pointers, so the same type goes through the same code as the converting ones.
+    vector(const vector& src, detail::__call_site where = detail::__call_site::current())
+        : m_alloc(Traits::select_on_container_copy_construction(src.m_alloc)), m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::copy_construct, src.m_trace.id());
+        copy_elements(src.data(), src.size());
+    }
+    vector(vector&& src, detail::__call_site where = detail::__call_site::current()) : m_alloc(allocator_from(std::move(src.m_alloc))), m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::move_construct, src.m_trace.id());
+        move_from(src);
+    }
+
+    // Allocator-extended copy and move, through which scoped_allocator_adaptor gives the vectors nested in a vector its inner
+    // allocator, so that for instance the blocks of all of them come from the same arena.
+    vector(const vector& src, const Alloc& alloc, detail::__call_site where = detail::__call_site::current()) : m_alloc(alloc), m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::copy_construct, src.m_trace.id());
+        copy_elements(src.data(), src.size());
+    }
+    vector(vector&& src, const Alloc& alloc, detail::__call_site where = detail::__call_site::current()) : m_alloc(alloc), m_profile(where) {
+        auto traced = m_trace.record(detail::__trace_op::move_construct, src.m_trace.id());
+        if (m_alloc == src.m_alloc)
+            move_from(src);
+        else {
+            take_elements(src.data(), src.size());
+            src.clear();
+        }
+    }
+
+    vector& operator=(const vector& src) { return operator=<Alloc>(src); }
+    vector& operator=(vector&& src) { return operator=<Alloc>(std::move(src)); }
+
+    ~vector() {
+        auto traced = m_trace.record(detail::__trace_op::destroy);
+        m_profile.record(size(), capacity());
+        destroy_me();
+    }
 
     template<typename A> vector& operator=(vector<T, A>&& src) {
+        auto traced = m_trace.record(detail::__trace_op::move_assign, src.m_trace.id());
         using BA = allocator_info::backing_allocator_of_t<A>;
+        if constexpr (takes_any_block<A>) {
+            if (Traits::propagate_on_container_move_assignment::value || Traits::is_always_equal::value || m_alloc == src.m_alloc) {
+                destroy_me();
+                if constexpr (Traits::propagate_on_container_move_assignment::value)
+                    m_alloc = std::move(src.m_alloc);
+
+                steal_block(src);
+                return *this;
+            }
+        }
         if constexpr (is_same_v<Backing, BA> && allocator_info::can_allocate<A>) {
-            if (src.capacity() > allocator_info::buffer_capacity<A> && src.size() > buffer_capacity) {  // src has allocated, and I will have to allocate
+            if (src.capacity() > allocator_info::buffer_capacity_of(src.m_alloc) && src.size() > buffer_capacity) {  // src has allocated, and I will have to allocate
                 if (std::allocator_traits<Backing>::propagate_on_container_move_assignment::value || allocator_traits<Backing>::is_always_equal::value || m_alloc == src.m_alloc) {  // And taking the src element vector is allowed
                     destroy_me();
                     if constexpr (std::allocator_traits<Backing>::propagate_on_container_move_assignment::value)
                         m_alloc = std::move(src.m_alloc);  // Unclear if this should happen even if !propagate_on_container_move_assignment.
 
-                    // move three pointers here, clear source's pointers.
-                    m_storage = move(src.m_storage);
-                    src.m_storage.m_begin = nullptr;
-                    src.m_storage.m_end = nullptr;
-                    src.m_storage.m_capacity = nullptr;
+                    steal_block(src);
                     return *this;   // Local return to avoid multiple else branches below.
                 }
             }
@@ -114,6 +301,7 @@ public:
     }
 
     template<typename A> vector& operator=(const vector<T, A>& src) {
+        auto traced = m_trace.record(detail::__trace_op::copy_assign, src.m_trace.id());
         using BA = allocator_info::backing_allocator_of_t<A>;
         // CppReference writes that the allocator copy should happen first and then discuesses what to do if the allocators _would
         // have_ compared unequal. I don't understand how that is not the same as the code here, barring possibly an exception
@@ -128,6 +316,7 @@ public:
         }
 
         copy_elements(src.data(), src.size());
+        return *this;
     }
 
 
@@ -144,6 +333,7 @@ public:
         else
             return m_alloc.allocate(0);
     }
+    const T* data() const { return const_cast<vector*>(this)->data(); }      // allocate(0) of a buffered_allocator just returns the buffer.
     size_type size() const {
         if constexpr (can_allocate)
             return m_storage.m_end - m_storage.m_begin;
@@ -153,29 +343,56 @@ public:
     bool empty() const { return size() == 0; }
 
     void push_back(const T& elem) {
+        auto traced = m_trace.record(detail::__trace_op::push_back);
         bump(size() + 1);
         Traits::construct(m_alloc, end(), elem);
         set_size(size() + 1);
     }
     void pop_back() {
+        auto traced = m_trace.record(detail::__trace_op::pop_back);
         set_size(size() - 1);
         Traits::destroy(m_alloc, end());
     }
 
     void reserve(size_type sz) {
+        auto traced = m_trace.record(detail::__trace_op::reserve, sz);
         if (sz <= capacity())
             return;
 
-        if constexpr (can_allocate) {
-            auto result = allocator_info::allocate_at_least(m_alloc, sz);
+        if constexpr (can_allocate && detail::__trivially_relocatable<T, Alloc>) {
+            [[maybe_unused]] size_type old_capacity = capacity();       // Only for the probe.
+            detail::__raw_block block = detail::__grow_trivially_relocatable({ data(), size(), capacity() }, sz, sizeof(T), raw_allocator());
+            P2667_PROBE4(vector_reserve, sizeof(T), old_capacity, block.capacity, P2667_PROBE_TYPE(Alloc));
+
+            m_storage.m_begin = static_cast<T*>(block.begin);
+            m_storage.m_capacity = m_storage.m_begin + block.capacity;
+            m_storage.m_end = m_storage.m_begin + block.size;
+        }
+        else if constexpr (can_allocate) {
+            auto result = allocate_block(sz);
+            P2667_PROBE4(vector_reserve, sizeof(T), capacity(), result.count, P2667_PROBE_TYPE(Alloc));
 
             size_type old_size = size();
 
-            // Move the data, deallocate old buffer... as today
-            for (size_type i = 0; i < old_size; i++)
-                Traits::construct(m_alloc, result.ptr + i, move(operator[](i)));
+            // Move the data, destroy the moved-from elements, deallocate old buffer... as today. Only in parallel if moving
+            // can't throw, as the elements which other threads have moved can't be moved back.
+            if (is_nothrow_move_constructible_v<T> && parallel(old_size)) {
+                construct_parallel(result.ptr, old_size, [&](T* p, size_type i) {
+                    Traits::construct(m_alloc, p, move(operator[](i)));
+                    Traits::destroy(m_alloc, data() + i);
+                });
+            }
+            else {
+                for (size_type i = 0; i < old_size; i++)
+                    Traits::construct(m_alloc, result.ptr + i, move(operator[](i)));
+                for (size_type i = 0; i < old_size; i++)
+                    Traits::destroy(m_alloc, data() + i);
+            }
 
-            Traits::deallocate(m_alloc, data(), capacity());
+            if constexpr (!allocator_info::deallocate_is_noop<Alloc>) {
+                if (data() != nullptr)
+                    deallocate_block();
+            }
 
             m_storage.m_begin = result.ptr;
             m_storage.m_capacity = result.ptr + result.count;
@@ -187,37 +404,268 @@ public:
             (void) allocator_info::allocate_at_least(m_alloc, sz);
     }
 
+    // Non-binding, as for std::vector. Only allocators which can resize blocks, like mmap_allocator, make use of it.
+    void shrink_to_fit() {
+        if constexpr (allocator_info::can_reallocate<Alloc> && detail::__trivially_relocatable<T, Alloc>) {
+            if (data() != nullptr && size() < capacity()) {
+                size_type old_size = size();
+                auto result = reallocate_block(old_size);
+                m_storage.m_begin = result.ptr;
+                m_storage.m_capacity = result.ptr + result.count;
+                m_storage.m_end = result.ptr + old_size;
+            }
+        }
+    }
+
+    // Elements whose value-initialized objects are all zero bytes are cleared with memset, or when the vector grows and the
+    // allocator has allocate_zeroed, taken as they come from it, so that for instance fresh pages are not even touched.
     void resize(size_type sz) {
+        auto traced = m_trace.record(detail::__trace_op::resize, sz);
+        if constexpr (can_allocate && detail::__zero_initializable<T, Alloc>) {
+            if (sz > size()) {
+                if (sz > capacity() && allocator_info::can_allocate_zeroed<Alloc>)
+                    grow_zeroed(max(sz, size() * 3 / 2));
+                else {
+                    bump(sz);
+                    if (parallel(sz - size()))
+                        zero_parallel(end(), sz - size());
+                    else
+                        memset(static_cast<void*>(end()), 0, (sz - size()) * sizeof(T));
+                }
+                set_size(sz);
+                return;
+            }
+        }
+
         if (sz > size()) {
+            // Constructed in place rather than copied from a temporary, so that a scoped_allocator_adaptor can give the new
+            // elements its inner allocator.
             bump(sz);
-            while (size() < sz)
-                push_back({});
+            if (parallel(sz - size())) {
+                construct_parallel(end(), sz - size(), [&](T* p, size_type) { Traits::construct(m_alloc, p); });
+                set_size(sz);
+            }
+            else {
+                while (size() < sz) {
+                    Traits::construct(m_alloc, end());
+                    set_size(size() + 1);
+                }
+            }
         }
         else {
             while (size() > sz)
                 pop_back();
         }
     }
-    void clear() { resize(0); }
+    void clear() {
+        auto traced = m_trace.record(detail::__trace_op::clear);
+        resize(0);
+    }
+
+    Alloc get_allocator() const { return m_alloc; }
+
+    // Hand over the elements and their block to the caller, leaving the vector empty. Elements which may be in a buffer, as the
+    // capacity is not above its size, are first moved to a block from the backing allocator, so the block can always be
+    // deallocated by the backing allocator or adopted by a vector with the same backing allocator. In the trace this is a clear.
+    vector_block<T, Backing> release() requires can_allocate {
+        auto traced = m_trace.record(detail::__trace_op::clear);
+        if (data() != nullptr && capacity() <= allocator_info::buffer_capacity_of(m_alloc)) {
+            vector<T, Backing> spilled{ static_cast<const Backing&>(m_alloc) };
+            spilled.take_elements(data(), size());
+            clear();
+            return spilled.release();
+        }
+
+        vector_block<T, Backing> block{ data(), size(), capacity() };
+        m_storage.m_begin = nullptr;
+        m_storage.m_end = nullptr;
+        m_storage.m_capacity = nullptr;
+        return block;
+    }
+
+    // Take over size elements in a block of capacity elements allocated by an allocator of type From, destroying my own elements
+    // first. The block is deallocated by my allocator, which passes blocks outside its buffer on to its backing allocator, so
+    // From must have the same backing allocator type, and the allocator that allocated the block must compare equal to mine.
+    // From can't be deduced from a raw pointer and has no default, so the caller names it: v.adopt<std::allocator<T>>(p, n, c).
+    // In the trace this is a resize.
+    template<typename From> void adopt(T* ptr, size_type size, size_type capacity) requires can_allocate {
+        static_assert(is_same_v<allocator_info::backing_allocator_of_t<From>, Backing>,
+                      "vector::adopt: the block must be from an allocator with the same backing allocator as the vector");
+        auto traced = m_trace.record(detail::__trace_op::resize, size);
+        destroy_me();
+        m_storage.m_begin = ptr;
+        m_storage.m_end = ptr + size;
+        m_storage.m_capacity = ptr + capacity;
+        m_profile.note_size(size);
+    }
+    template<typename From> void adopt(const vector_block<T, From>& block) requires can_allocate {
+        adopt<From>(block.ptr, block.size, block.capacity);
+    }
 
     // Used by tests
     T& operator[](size_t ix) { return data()[ix]; }
+    const T& operator[](size_t ix) const { return data()[ix]; }
     T* begin() { return data(); }
     T* end() { return begin() + size(); }
 
 private:
+    // Like for a regular move constructor the allocator is taken from the source if it has the same backing allocator, even
+    // if the elements end up being moved one by one. Constructed rather than assigned as for instance
+    // pmr::polymorphic_allocator can't be assigned.
+    template<typename A> static Alloc allocator_from(A&& src) {
+        if constexpr (is_same_v<Backing, allocator_info::backing_allocator_of_t<remove_cvref_t<A>>>)
+            return Alloc(std::forward<A>(src));
+        else
+            return Alloc();
+    }
+
+    template<typename A> void move_from(vector<T, A>& src) {
+        using BA = allocator_info::backing_allocator_of_t<A>;
+        if constexpr (takes_any_block<A>) {
+            steal_block(src);       // My allocator is a copy of src's.
+            return;
+        }
+        else if constexpr (is_same_v<Backing, BA> && allocator_info::can_allocate<A>) {
+            if (src.capacity() > allocator_info::buffer_capacity_of(src.m_alloc) && src.size() > buffer_capacity) { // src has allocated, and I would have to allocate
+                steal_block(src);
+                return;
+            }
+        }
+
+        take_elements(src.data(), src.size());
+        src.clear();   // Always leave source empty even if it had to be copied.
+    }
+
+    // A block of a vector of the same type can be taken over even if it is in a buffer, if the buffer is not inside the allocator
+    // object, so that my allocator can deallocate it if it compares equal to the source's.
+    template<typename A> static constexpr bool takes_any_block = is_same_v<A, Alloc> && can_allocate && buffer_capacity == 0;
+
+    // move three pointers here, clear source's pointers.
+    template<typename A> void steal_block(vector<T, A>& src) {
+        m_storage = move(src.m_storage);
+        src.m_storage.m_begin = nullptr;
+        src.m_storage.m_end = nullptr;
+        src.m_storage.m_capacity = nullptr;
+    }
+
     void destroy_me() {
+        if constexpr (allocator_info::deallocate_is_noop<Alloc> && is_trivially_destructible_v<T>)
+            return;     // Nothing to do, the memory is reclaimed in bulk by the allocator.
+
         clear();
+        if constexpr (!allocator_info::deallocate_is_noop<Alloc>) {
+            if (data() != nullptr)
+                deallocate_block();
+        }
+    }
+
+    // All allocator calls which move the vector to a new block go through these, so that they can be timed.
+    auto allocate_block(size_type sz) {
+        detail::__latency_scope<Alloc> timer(detail::__allocation_op::allocate_at_least);
+        return allocator_info::allocate_at_least(m_alloc, sz);
+    }
+    void deallocate_block() {
+        detail::__latency_scope<Alloc> timer(detail::__allocation_op::deallocate);
         Traits::deallocate(m_alloc, data(), capacity());
     }
+    // Move the elements to a zeroed block of at least sz elements, so that the ones after them need no initialization.
+    void grow_zeroed(size_type sz) {
+        if constexpr (allocator_info::can_allocate_zeroed<Alloc>) {
+            allocation_result<T*> result;
+            {
+                detail::__latency_scope<Alloc> timer(detail::__allocation_op::allocate_at_least);
+                auto zeroed = allocator_info::allocate_zeroed(m_alloc, sz);
+                result = { zeroed.ptr, zeroed.count };
+            }
+            P2667_PROBE4(vector_reserve, sizeof(T), capacity(), result.count, P2667_PROBE_TYPE(Alloc));
+
+            size_type old_size = size();
+            if (old_size != 0)
+                copy_bytes(result.ptr, data(), old_size);
+            if constexpr (!allocator_info::deallocate_is_noop<Alloc>) {
+                if (data() != nullptr)
+                    deallocate_block();
+            }
+
+            m_storage.m_begin = result.ptr;
+            m_storage.m_capacity = result.ptr + result.count;
+            m_storage.m_end = result.ptr + old_size;
+        }
+    }
+    auto reallocate_block(size_type sz) requires allocator_info::can_reallocate<Alloc> {
+        detail::__latency_scope<Alloc> timer(detail::__allocation_op::allocate_at_least);    // It replaces the allocation.
+        return allocator_info::reallocate(m_alloc, data(), capacity(), sz);
+    }
+
+    static constexpr size_type parallel_threshold = parallel_bulk_threshold<T, Alloc>::value;
+    static constexpr bool parallel(size_type count) { return parallel_threshold != 0 && count >= parallel_threshold; }
+
+    // Construct count elements from dest on with make(p, i), on the bulk thread pool. If a construction throws the elements
+    // constructed by the other threads are destroyed too before the exception is rethrown, so none are left.
+    template<typename F> void construct_parallel(T* dest, size_type count, F make) {
+        if constexpr (parallel_threshold != 0) {       // Not even instantiated for vector types which don't opt in.
+            auto destroy = [&](size_type begin, size_type end) {
+                for (size_type i = begin; i < end; i++)
+                    Traits::destroy(m_alloc, dest + i);
+            };
+            detail::__bulk_for(count, [&](size_type begin, size_type end) {
+                size_type i = begin;
+                try {
+                    for (; i < end; i++)
+                        make(dest + i, i);
+                }
+                catch (...) {
+                    destroy(begin, i);
+                    throw;
+                }
+            }, destroy);
+        }
+    }
+
+    void zero_parallel(T* dest, size_type count) {
+        if constexpr (parallel_threshold != 0)
+            detail::__bulk_zero(dest, count * sizeof(T));
+    }
+
+    void copy_bytes(T* dest, const T* src, size_type count) {
+        if constexpr (parallel_threshold != 0) {
+            if (parallel(count))
+                return detail::__bulk_copy(dest, src, count * sizeof(T));
+        }
+        detail::__copy_elements(dest, src, count * sizeof(T));
+    }
+
+    // The per vector type part of __grow_trivially_relocatable.
+    detail::__raw_allocator raw_allocator() {
+        auto allocate = [](void* self, size_t count) -> allocation_result<void*> {
+            auto result = static_cast<vector*>(self)->allocate_block(count);
+            return { result.ptr, result.count };
+        };
+        detail::__raw_allocator raw{ this, allocate, nullptr, nullptr, nullptr, 0 };
+        if constexpr (!allocator_info::deallocate_is_noop<Alloc>)
+            raw.deallocate = [](void* self) { static_cast<vector*>(self)->deallocate_block(); };
+        if constexpr (parallel_threshold != 0) {       // Only then is the thread pool linked in.
+            raw.bulk_copy = detail::__bulk_copy;
+            raw.parallel_bytes = parallel_threshold * sizeof(T);
+        }
+        if constexpr (allocator_info::can_reallocate<Alloc>) {
+            raw.reallocate = [](void* self, size_t count) -> allocation_result<void*> {
+                auto result = static_cast<vector*>(self)->reallocate_block(count);
+                return { result.ptr, result.count };
+            };
+        }
+        return raw;
+    }
+
     void bump(size_type sz) {
-        if (sz <= size())
+        if (sz <= capacity())
             return;
 
         reserve(max(sz, size() * 3 / 2));
     }
 
     void set_size(size_type sz) {
+        m_profile.note_size(sz);
         if constexpr (can_allocate)
             m_storage.m_end = m_storage.m_begin + sz;
         else
@@ -225,6 +673,9 @@ private:
     }
 
     void take_elements(T* src, size_type count) {
+        if constexpr (detail::__trivially_relocatable<T, Alloc>)
+            return copy_elements(src, count);
+
         reserve(count);
 
         T* dest = data();
@@ -251,8 +702,13 @@ private:
 
         set_size(count);
     }
-    void copy_elements(T* src, size_type count) {
+    void copy_elements(const T* src, size_type count) {
         reserve(count);
+        if constexpr (detail::__trivially_relocatable<T, Alloc>) {
+            copy_bytes(data(), src, count);     // src may be my own elements.
+            set_size(count);
+            return;
+        }
 
         T* dest = data();
 
@@ -261,9 +717,14 @@ private:
             dest = copy(src, src + size(), dest);
 
             // Construct the rest
-            for (size_type i = size(); i < count; i++) {
-                Traits::construct(m_alloc, dest, src[i]);
-                dest++;
+            size_type assigned = size();
+            if (parallel(count - assigned))
+                construct_parallel(dest, count - assigned, [&](T* p, size_type i) { Traits::construct(m_alloc, p, src[assigned + i]); });
+            else {
+                for (size_type i = size(); i < count; i++) {
+                    Traits::construct(m_alloc, dest, src[i]);
+                    dest++;
+                }
             }
         }
         else {
@@ -283,6 +744,8 @@ private:
     // Order between storage and allocator preserved.
     detail::vector_storage<T, can_allocate ? 0 : buffer_capacity> m_storage;
     [[no_unique_address]] Alloc m_alloc;        // No need for empty base optimization anymore.
+    [[no_unique_address]] detail::__capacity_profile<vector> m_profile;
+    [[no_unique_address]] detail::__vector_trace m_trace;
 };
 
 
@@ -0,0 +1,106 @@
+# Compile code_size_instance.cpp for each combination of element type, SZ and Backing, and report how much code the
+# vector instantiation adds to the object file, summing the function symbols nm --size-sort lists, and how much longer it
+# takes to compile than the headers alone. Needs CMake 3.23 for sub-second timestamps.
+#
+#   cmake -DCXX=c++ -DNM=nm -DSOURCE_DIR=path/to/sources -DOUTPUT=code_size.tsv [-DFLAGS=-O2] -P measure_code_size.cmake
+#
+# Only Backings which can be default constructed are in the matrix, as the explicit instantiation includes the default
+# constructor. SZ 0 is vector<T, Backing> without buffer, and unchecked_allocator, which makes a static_vector, is only
+# used with a buffer.
+
+cmake_minimum_required(VERSION 3.23)
+
+if (NOT DEFINED FLAGS)
+    set(FLAGS -O2)
+endif()
+
+set(types int double blob32 string)
+set(sizes 0 4 16 64)
+set(backings allocator thread_caching_allocator unchecked_allocator)
+
+get_filename_component(object_dir ${OUTPUT} DIRECTORY)
+set(object ${object_dir}/code_size_instance.o)
+
+# Compile with the given definitions and set bytes and symbols to the size and number of the functions in the object, and
+# microseconds to the compile time.
+function(measure definitions)
+    string(TIMESTAMP start "%s%f" UTC)
+    execute_process(COMMAND ${CXX} -std=c++20 ${FLAGS} ${definitions} -c ${SOURCE_DIR}/code_size_instance.cpp -o ${object}
+                    RESULT_VARIABLE result ERROR_VARIABLE errors)
+    string(TIMESTAMP stop "%s%f" UTC)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Compiling with ${definitions} failed:\n${errors}")
+    endif()
+
+    execute_process(COMMAND ${NM} --size-sort --print-size ${object} OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${NM} failed: ${result}")
+    endif()
+
+    set(total 0)
+    set(count 0)
+    string(REPLACE "\n" ";" lines "${symbols}")
+    foreach (line IN LISTS lines)
+        if (line MATCHES "^[0-9a-fA-F]+ ([0-9a-fA-F]+) [tTW] ")
+            math(EXPR total "${total} + 0x${CMAKE_MATCH_1}")
+            math(EXPR count "${count} + 1")
+        endif()
+    endforeach()
+
+    math(EXPR elapsed "${stop} - ${start}")
+    set(bytes ${total} PARENT_SCOPE)
+    set(symbols ${count} PARENT_SCOPE)
+    set(microseconds ${elapsed} PARENT_SCOPE)
+endfunction()
+
+function(to_seconds microseconds out)
+    math(EXPR whole "${microseconds} / 1000000")
+    math(EXPR fraction "(${microseconds} % 1000000) / 1000 + 1000")
+    string(SUBSTRING ${fraction} 1 3 fraction)
+    set(${out} "${whole}.${fraction}" PARENT_SCOPE)
+endfunction()
+
+
+# Sizes only compare between reports of the same compiler and flags, so the report starts with them.
+execute_process(COMMAND ${CXX} --version OUTPUT_VARIABLE version RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${CXX} --version failed: ${result}")
+endif()
+string(REGEX MATCH "^[^\n]*" version "${version}")
+message(STATUS "${version}, ${FLAGS}")
+
+measure("")
+set(base_bytes ${bytes})
+set(base_symbols ${symbols})
+set(base_microseconds ${microseconds})
+to_seconds(${microseconds} seconds)
+message(STATUS "Headers alone: ${bytes} bytes of code in ${symbols} functions, ${seconds} s")
+
+set(report "# ${version}, ${FLAGS}\n# type\tSZ\tbacking\tcode_bytes\tfunctions\tcompile_seconds\n")
+set(total_bytes 0)
+foreach (type IN LISTS types)
+    foreach (size IN LISTS sizes)
+        foreach (backing IN LISTS backings)
+            if (size EQUAL 0 AND backing STREQUAL "unchecked_allocator")
+                continue()
+            endif()
+
+            measure("-DP2667_T=${type};-DP2667_SZ=${size};-DP2667_BACKING=${backing}")
+            math(EXPR bytes "${bytes} - ${base_bytes}")
+            math(EXPR symbols "${symbols} - ${base_symbols}")
+            math(EXPR microseconds "${microseconds} - ${base_microseconds}")
+            if (microseconds LESS 0)
+                set(microseconds 0)
+            endif()
+            to_seconds(${microseconds} seconds)
+            math(EXPR total_bytes "${total_bytes} + ${bytes}")
+
+            string(APPEND report "${type}\t${size}\t${backing}\t${bytes}\t${symbols}\t${seconds}\n")
+            message(STATUS "${type}, SZ ${size}, ${backing}: ${bytes} bytes in ${symbols} functions, +${seconds} s")
+        endforeach()
+    endforeach()
+endforeach()
+
+file(REMOVE ${object})
+file(WRITE ${OUTPUT} "${report}")
+message(STATUS "${total_bytes} bytes in all, written to ${OUTPUT}")
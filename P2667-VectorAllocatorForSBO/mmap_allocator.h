@@ -0,0 +1,183 @@
+#pragma once
+
+/// Allocator which maps each block directly from the operating system, for vectors of hundreds of millions of trivially
+/// copyable elements. It has the allocator_info::reallocate hook, so growing such a vector is an mremap, which moves page
+/// table entries instead of copying the elements. Shrinking gives the pages beyond the new size back to the operating system
+/// with madvise(MADV_DONTNEED) but keeps them mapped, so the capacity stays and growing back into them is free. It also has
+/// the allocator_info::allocate_zeroed hook, so a value-initialized vector of numbers, like a large histogram, is allocated
+/// without touching its pages.
+///
+///     std::vector<int, std::mmap_allocator<int>> huge;
+///
+/// The Options parameter selects, per vector type, transparent huge pages and prefaulting for large lookup tables, which
+/// otherwise suffer TLB misses and first-touch page faults:
+///
+///     std::vector<Entry, std::mmap_allocator<Entry, std::mmap_options::huge_pages | std::mmap_options::populate>> table;
+///
+/// As the Backing of an sbo_vector it only applies to spilled blocks.
+///
+/// With huge_pages, blocks of at least 2 MiB are aligned to and rounded up to 2 MiB and marked with madvise(MADV_HUGEPAGE).
+/// With populate, all pages of a block are faulted in when it is allocated or grown, with MAP_POPULATE, or when huge pages
+/// are used, with MADV_POPULATE_WRITE after the madvise so that the huge pages are the ones faulted in.
+///
+/// Linux only. Every block is a whole number of pages, so it is a poor choice for small vectors.
+
+#include "experimental_memory.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace std {
+
+enum class mmap_options : unsigned {
+    none = 0,
+    huge_pages = 1,
+    populate = 2,
+};
+
+constexpr mmap_options operator|(mmap_options lhs, mmap_options rhs) { return mmap_options(unsigned(lhs) | unsigned(rhs)); }
+constexpr bool operator&(mmap_options lhs, mmap_options rhs) { return (unsigned(lhs) & unsigned(rhs)) != 0; }
+
+
+namespace detail {
+
+constexpr size_t __huge_page_size = size_t(2) << 20;
+
+inline size_t __page_size() {
+    static const size_t size = size_t(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+inline size_t __round_to_pages(size_t bytes) {
+    size_t page = __page_size();
+    return (bytes + page - 1) / page * page;
+}
+
+// Map bytes, a multiple of __huge_page_size, at an address aligned to it, by mapping more and unmapping the ends.
+inline void* __map_huge_aligned(size_t bytes) {
+    void* reserved = mmap(nullptr, bytes + __huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED)
+        return MAP_FAILED;
+
+    char* begin = static_cast<char*>(reserved);
+    char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + __huge_page_size - 1) & ~(__huge_page_size - 1));
+    if (aligned != begin)
+        munmap(begin, aligned - begin);
+    if (size_t tail = begin + __huge_page_size - aligned)
+        munmap(aligned + bytes, tail);
+    return aligned;
+}
+
+// Fault in the pages of a range, in case the kernel is too old for MADV_POPULATE_WRITE by touching each page.
+inline void __prefault(void* p, size_t bytes) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(p, bytes, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    for (size_t offset = 0; offset < bytes; offset += __page_size())
+        static_cast<volatile char*>(p)[offset] = 0;
+}
+
+}  // namespace detail
+
+
+// Stateless, so any mmap_allocator with the same options can deallocate or reallocate a block of another. The counts given
+// back by allocate_at_least and reallocate fill the mapped pages, and any count which rounds up to the same pages is accepted.
+template<typename T, mmap_options Options = mmap_options::none> class mmap_allocator {
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using is_always_equal = true_type;
+
+    template<typename U> struct rebind {
+        using other = mmap_allocator<U, Options>;
+    };
+
+    mmap_allocator() = default;
+    template<typename U> mmap_allocator(const mmap_allocator<U, Options>&) {}
+
+    T* allocate(size_type count) { return allocate_at_least(count).ptr; }
+    void deallocate(T* p, size_type count) { munmap(p, mapped_bytes(count)); }
+
+    allocation_result<T*> allocate_at_least(size_type count) {
+        if (count > max_size())
+            throw bad_array_new_length();
+
+        size_t bytes = mapped_bytes(max<size_type>(count, 1));
+        void* p;
+        if (uses_huge_pages(bytes))
+            p = detail::__map_huge_aligned(bytes);
+        else
+            p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | populate_flag, -1, 0);
+        if (p == MAP_FAILED)
+            throw bad_alloc();
+
+        if (uses_huge_pages(bytes))
+            advise(p, 0, bytes);
+        return { static_cast<T*>(p), bytes / sizeof(T) };
+    }
+
+    // Fresh mappings are zero pages, which the kernel only clears when they are touched.
+    allocation_result<T*> allocate_zeroed(size_type count) { return allocate_at_least(count); }
+
+    allocation_result<T*> reallocate(T* p, size_type old_count, size_type new_count) {
+        if (new_count > max_size())
+            throw bad_array_new_length();
+
+        size_t old_bytes = mapped_bytes(old_count);
+        size_t new_bytes = mapped_bytes(new_count);
+        if (new_bytes <= old_bytes) {
+            if (new_bytes < old_bytes)
+                madvise(reinterpret_cast<char*>(p) + new_bytes, old_bytes - new_bytes, MADV_DONTNEED);
+            return { p, old_bytes / sizeof(T) };
+        }
+
+        // With huge pages the block is moved to an aligned reservation, still without copying.
+        void* moved;
+        if (uses_huge_pages(new_bytes)) {
+            void* target = detail::__map_huge_aligned(new_bytes);
+            if (target == MAP_FAILED)
+                throw bad_alloc();
+            moved = mremap(p, old_bytes, new_bytes, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+            if (moved == MAP_FAILED)
+                munmap(target, new_bytes);
+        }
+        else
+            moved = mremap(p, old_bytes, new_bytes, MREMAP_MAYMOVE);
+        if (moved == MAP_FAILED)
+            throw bad_alloc();
+
+        if (uses_huge_pages(new_bytes))
+            advise(moved, old_bytes, new_bytes);
+        else if constexpr (Options & mmap_options::populate)
+            detail::__prefault(static_cast<char*>(moved) + old_bytes, new_bytes - old_bytes);
+        return { static_cast<T*>(moved), new_bytes / sizeof(T) };
+    }
+
+    static constexpr size_type max_size() { return (size_type(-1) / 2) / sizeof(T); }
+
+    friend bool operator==(const mmap_allocator&, const mmap_allocator&) { return true; }
+
+private:
+    static constexpr int populate_flag = Options & mmap_options::populate ? MAP_POPULATE : 0;
+
+    static bool uses_huge_pages(size_t bytes) { return (Options & mmap_options::huge_pages) && bytes >= detail::__huge_page_size; }
+
+    static size_t mapped_bytes(size_type count) {
+        size_t bytes = count * sizeof(T);
+        if (uses_huge_pages(bytes))
+            return (bytes + detail::__huge_page_size - 1) & ~(detail::__huge_page_size - 1);
+
+        return detail::__round_to_pages(bytes);
+    }
+
+    // Mark a block for huge pages, and fault in the part of it from offset on if asked to.
+    static void advise(void* p, size_t offset, size_t bytes) {
+        madvise(p, bytes, MADV_HUGEPAGE);
+        if constexpr (Options & mmap_options::populate)
+            detail::__prefault(static_cast<char*>(p) + offset, bytes - offset);
+    }
+};
+
+}  // namespace std
@@ -0,0 +1,188 @@
+#pragma once
+
+/// Thread pool for vector's bulk construction, copying and relocation of elements, used by the vector types which opt in by
+/// specializing std::parallel_bulk_threshold (see experimental_vector.h). The work is split in one chunk per thread, and
+/// the calling thread takes the first. All vectors share the pool. When it is busy, for instance because the elements being
+/// constructed on it are themselves large vectors which opt in, the work is done on the calling thread instead of waiting.
+///
+/// std::set_parallel_bulk_threads() sets the number of threads to use, including the calling thread. The default is the
+/// hardware concurrency, up to 8.
+
+#include "streaming_copy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace std {
+namespace detail {
+
+constexpr size_t __max_bulk_threads = 64;
+
+constexpr size_t __bulk_chunk_begin(size_t count, size_t chunks, size_t chunk) { return count * chunk / chunks; }
+
+
+// Never destroyed, and its threads are detached, as vectors may be copied during program exit.
+class __bulk_pool {
+public:
+    using task = void (*)(void* context, size_t begin, size_t end);
+
+    static __bulk_pool& instance() {
+        static __bulk_pool& pool = *new __bulk_pool;
+        return pool;
+    }
+
+    atomic<size_t>& threads() { return m_threads; }
+
+    // Run task over the chunks of [0, count), storing what each chunk throws in errors. Returns the number of chunks.
+    size_t run(size_t count, task t, void* context, exception_ptr* errors) {
+        size_t chunks = min(m_threads.load(memory_order_relaxed), count);
+        if (chunks <= 1 || m_busy.exchange(true, memory_order_acquire)) {
+            run_chunk(t, context, 0, count, errors[0]);
+            return 1;
+        }
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+
+            // The pool is claimed, so a failure to start more threads must not escape. Make do with those there are, which
+            // may be none, in which case the calling thread does it all.
+            try {
+                for (; m_started + 1 < chunks; m_started++)
+                    thread(&__bulk_pool::work, this, m_started + 1).detach();
+            }
+            catch (...) {
+                chunks = m_started + 1;
+            }
+
+            m_task = t;
+            m_context = context;
+            m_count = count;
+            m_chunks = chunks;
+            m_errors = errors;
+            m_pending.store(chunks - 1, memory_order_relaxed);
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        run_chunk(t, context, 0, __bulk_chunk_begin(count, chunks, 1), errors[0]);
+
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_done.wait(lock, [&] { return m_pending.load(memory_order_acquire) == 0; });
+        }
+        m_busy.store(false, memory_order_release);
+        return chunks;
+    }
+
+private:
+    __bulk_pool() : m_threads(clamp<size_t>(thread::hardware_concurrency(), 1, 8)) {}
+
+    static void run_chunk(task t, void* context, size_t begin, size_t end, exception_ptr& error) {
+        try {
+            t(context, begin, end);
+        }
+        catch (...) {
+            error = current_exception();
+        }
+    }
+
+    // Worker index runs chunk index of each job which has that many chunks.
+    void work(size_t index) {
+        uint64_t seen = 0;
+        for (;;) {
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_generation != seen; });
+            seen = m_generation;
+            if (index >= m_chunks)
+                continue;
+
+            task t = m_task;
+            void* context = m_context;
+            size_t begin = __bulk_chunk_begin(m_count, m_chunks, index);
+            size_t end = __bulk_chunk_begin(m_count, m_chunks, index + 1);
+            exception_ptr& error = m_errors[index];
+            lock.unlock();
+
+            run_chunk(t, context, begin, end, error);
+            if (m_pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+                lock_guard<mutex> done(m_mutex);
+                m_done.notify_one();
+            }
+        }
+    }
+
+    atomic<size_t> m_threads;
+    atomic<bool> m_busy{false};     // Not a mutex, as the thread running a job may try to start another.
+
+    mutex m_mutex;                  // Guards the job and m_started.
+    condition_variable m_wake;
+    condition_variable m_done;
+    size_t m_started = 0;
+    uint64_t m_generation = 0;
+    task m_task = nullptr;
+    void* m_context = nullptr;
+    size_t m_count = 0;
+    size_t m_chunks = 0;
+    exception_ptr* m_errors = nullptr;
+    atomic<size_t> m_pending{0};
+};
+
+
+// Run body(begin, end) over the chunks of [0, count) on the pool. If any chunk throws, undo(begin, end) is run for the
+// chunks which didn't, and the first exception is rethrown. A chunk which throws must clean up after itself.
+template<typename Body, typename Undo> void __bulk_for(size_t count, Body&& body, Undo&& undo) {
+    using body_type = remove_reference_t<Body>;
+    auto t = [](void* context, size_t begin, size_t end) { (*static_cast<body_type*>(context))(begin, end); };
+
+    exception_ptr errors[__max_bulk_threads];
+    size_t chunks = __bulk_pool::instance().run(count, t, const_cast<void*>(static_cast<const void*>(&body)), errors);
+
+    exception_ptr first;
+    for (size_t chunk = 0; chunk < chunks && !first; chunk++)
+        first = errors[chunk];
+    if (!first)
+        return;
+
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        if (!errors[chunk])
+            undo(__bulk_chunk_begin(count, chunks, chunk), __bulk_chunk_begin(count, chunks, chunk + 1));
+    }
+    rethrow_exception(first);
+}
+
+// Copy of the elements of vectors, like __copy_elements, on the pool. Streaming stores are used if the whole copy is above
+// the streaming copy threshold.
+inline void __bulk_copy(void* dest, const void* src, size_t bytes) {
+    if (dest == src || bytes == 0)
+        return;
+
+    bool streaming = bytes >= __streaming_copy_threshold().load(memory_order_relaxed);
+    __bulk_for(bytes, [&](size_t begin, size_t end) {
+        if (streaming)
+            __copy_streaming(static_cast<char*>(dest) + begin, static_cast<const char*>(src) + begin, end - begin);
+        else
+            memcpy(static_cast<char*>(dest) + begin, static_cast<const char*>(src) + begin, end - begin);
+    }, [](size_t, size_t) {});
+}
+
+inline void __bulk_zero(void* dest, size_t bytes) {
+    __bulk_for(bytes, [&](size_t begin, size_t end) { memset(static_cast<char*>(dest) + begin, 0, end - begin); },
+               [](size_t, size_t) {});
+}
+
+}  // namespace detail
+
+
+// Set the number of threads, including the calling thread, that vectors which opt in with parallel_bulk_threshold use for
+// their bulk operations. Returns the previous number.
+inline size_t set_parallel_bulk_threads(size_t threads) {
+    return detail::__bulk_pool::instance().threads().exchange(clamp<size_t>(threads, 1, detail::__max_bulk_threads),
+                                                              memory_order_relaxed);
+}
+
+}  // namespace std
@@ -0,0 +1,155 @@
+#pragma once
+
+/// Hardware performance counters for the benchmark harness, read with Linux perf_event_open. The counters are opened as
+/// one group so that they are scheduled together, and only count user space code, which works with the default
+/// perf_event_paranoid setting. Counters the CPU or a virtual machine doesn't support are left out, and on other systems
+/// or where perf_event_open is not allowed none are available and the harness only reports times.
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define BENCH_PERF_EVENTS 1
+#else
+#define BENCH_PERF_EVENTS 0
+#endif
+
+namespace bench {
+
+class perf_counters {
+public:
+    enum counter { cycles, instructions, branch_misses, l1d_misses, llc_misses, counter_count };
+
+    static const char* name(counter c) {
+        static const char* const names[] = { "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses" };
+        return names[c];
+    }
+
+    explicit perf_counters(bool enabled = true) {
+        for (int& fd : m_fds)
+            fd = -1;
+
+#if BENCH_PERF_EVENTS
+        if (!enabled)
+            return;
+
+        // Cycles lead the group, without it the others are not opened either.
+        open(cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        if (m_fds[cycles] < 0)
+            return;
+
+        open(instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open(branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        open(l1d_misses, PERF_TYPE_HW_CACHE,
+             PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        open(llc_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        if (!schedulable())
+            close_all();
+#else
+        (void)enabled;
+#endif
+    }
+    ~perf_counters() {
+#if BENCH_PERF_EVENTS
+        close_all();
+#endif
+    }
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const { return m_fds[cycles] >= 0; }
+    bool available(counter c) const { return m_fds[c] >= 0; }
+
+#if BENCH_PERF_EVENTS
+    void reset() { group_ioctl(PERF_EVENT_IOC_RESET); }
+    void enable() { group_ioctl(PERF_EVENT_IOC_ENABLE); }
+    void disable() { group_ioctl(PERF_EVENT_IOC_DISABLE); }
+#else
+    void reset() {}
+    void enable() {}
+    void disable() {}
+#endif
+
+    // Counts since reset(), scaled up if the group was multiplexed with other events. Counters which are not available, or
+    // if the group was never scheduled, are -1.
+    void read(double (&values)[counter_count]) const {
+        for (double& value : values)
+            value = -1;
+
+#if BENCH_PERF_EVENTS
+        if (!available())
+            return;
+
+        struct {
+            uint64_t nr;
+            uint64_t time_enabled;
+            uint64_t time_running;
+            uint64_t values[counter_count];
+        } data;
+        if (::read(m_fds[cycles], &data, sizeof(data)) <= 0 || data.time_running == 0)
+            return;
+
+        double scale = double(data.time_enabled) / double(data.time_running);
+        uint64_t next = 0;
+        for (int c = 0; c < counter_count; c++) {
+            if (m_fds[c] >= 0 && next < data.nr)
+                values[c] = double(data.values[next++]) * scale;
+        }
+#endif
+    }
+
+private:
+#if BENCH_PERF_EVENTS
+    void open(counter c, uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = c == cycles;        // Members follow the leader.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        m_fds[c] = int(syscall(SYS_perf_event_open, &attr, 0, -1, c == cycles ? -1 : m_fds[cycles], 0));
+
+        // A group is only scheduled if all its members fit the PMU at once, so drop a member which doesn't fit.
+        if (c != cycles && m_fds[c] >= 0 && !schedulable()) {
+            close(m_fds[c]);
+            m_fds[c] = -1;
+        }
+    }
+
+    bool schedulable() {
+        reset();
+        enable();
+        volatile int work = 0;
+        for (int i = 0; i < 1000; i++)
+            work = work + i;
+        disable();
+
+        uint64_t data[3 + counter_count];
+        return ::read(m_fds[cycles], data, sizeof(data)) > 0 && data[2] != 0;      // time_running
+    }
+
+    void close_all() {
+        for (int& fd : m_fds) {
+            if (fd >= 0)
+                close(fd);
+            fd = -1;
+        }
+    }
+
+    void group_ioctl(unsigned long request) {
+        if (available())
+            ioctl(m_fds[cycles], request, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+
+    int m_fds[counter_count];
+};
+
+}  // namespace bench
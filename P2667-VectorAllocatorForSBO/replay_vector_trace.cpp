@@ -0,0 +1,338 @@
+// Replays a trace recorded with P2667_TRACE_VECTORS (see vector_trace.h) against a number of allocator configurations and
+// reports the time and the heap allocations each needed. The elements are replaced by trivial blobs of the recorded size
+// rounded up to a power of two, so the replay shows the cost of the containers and their allocators, not of copying the
+// original elements or of the memory those own.
+//
+// Usage: replay_vector_trace trace.bin [configuration...]
+//
+// Without configurations all are run, otherwise those whose name contains one of the given strings.
+
+#include "experimental_vector.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+// Heap use during the replay, counted by replacing the global operator new. This includes the chunks of the arenas.
+std::atomic<size_t> heap_allocations{0};
+std::atomic<size_t> heap_bytes{0};
+
+void* counted_new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    heap_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return counted_new(size); }
+void* operator new[](size_t size) { return counted_new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+
+namespace {
+
+using std::detail::__trace_op;
+
+// Element sizes are rounded up to one of these, larger elements are replayed as the largest.
+using size_classes = std::integer_sequence<size_t, 1, 2, 4, 8, 16, 32, 64, 128, 256>;
+constexpr size_t size_class_count = size_classes::size();
+
+template<size_t N> struct alignas(N < alignof(std::max_align_t) ? N : alignof(std::max_align_t)) blob {
+    unsigned char bytes[N];
+};
+
+// A trace record with the vector ids replaced by slots, which are reused when vectors are destroyed so that the replay can
+// keep its vectors in arrays.
+struct replay_op {
+    __trace_op op;
+    uint8_t size_class;
+    uint32_t slot;
+    uint32_t source;        // Slot of the source of copies and moves.
+    uint64_t operand;       // Size of reserve and resize.
+};
+
+struct trace {
+    std::vector<replay_op> ops;
+    size_t slots[size_class_count] = {};
+    size_t records = 0;
+    size_t skipped = 0;         // Records of vectors whose construction is not in the trace.
+    size_t oversized = 0;       // Vectors with elements larger than the largest size class.
+};
+
+
+constexpr unsigned size_class_of(uint64_t element_size)
+{
+    unsigned c = 0;
+    while (c + 1 < size_class_count && (size_t(1) << c) < element_size)
+        c++;
+    return c;
+}
+
+// Read the trace and assign slots. Returns false and prints a message if the file can't be read or is corrupt.
+bool read_trace(const char* path, trace& result)
+{
+    FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        std::perror(path);
+        return false;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    long length = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    std::unique_ptr<uint8_t[]> data(new uint8_t[length > 0 ? length : 1]);
+    bool ok = length >= long(sizeof(std::detail::__trace_magic)) && std::fread(data.get(), 1, length, file) == size_t(length) &&
+              std::memcmp(data.get(), std::detail::__trace_magic, sizeof(std::detail::__trace_magic)) == 0;
+    std::fclose(file);
+    if (!ok) {
+        std::fprintf(stderr, "%s: not a vector trace\n", path);
+        return false;
+    }
+
+    struct live_vector {
+        uint8_t size_class;
+        uint32_t slot;
+    };
+    std::map<uint64_t, live_vector> live;
+    std::vector<uint32_t> free_slots[size_class_count];
+
+    auto new_slot = [&](unsigned size_class) {
+        std::vector<uint32_t>& free = free_slots[size_class];
+        if (free.empty())
+            return uint32_t(result.slots[size_class]++);
+
+        uint32_t slot = free[free.size() - 1];
+        free.pop_back();
+        return slot;
+    };
+
+    const uint8_t* in = data.get() + sizeof(std::detail::__trace_magic);
+    const uint8_t* end = data.get() + length;
+    while (in != end) {
+        __trace_op op = __trace_op(*in++);
+        uint64_t id = 0, operand = 0;
+        if (op >= __trace_op::count || !std::detail::__get_varint(in, end, id) ||
+            (std::detail::__trace_has_operand(op) && !std::detail::__get_varint(in, end, operand))) {
+            std::fprintf(stderr, "%s: corrupt record at offset %zu\n", path, size_t(in - data.get()));
+            return false;
+        }
+        result.records++;
+
+        replay_op record{ op, 0, 0, 0, operand };
+        if (op == __trace_op::create) {
+            if (operand > (size_t(1) << (size_class_count - 1)))
+                result.oversized++;
+            record.size_class = uint8_t(size_class_of(operand));
+        }
+        else if (op == __trace_op::copy_construct || op == __trace_op::move_construct) {
+            auto source = live.find(operand);
+            if (source == live.end()) {
+                result.skipped++;
+                continue;
+            }
+            record.size_class = source->second.size_class;
+            record.source = source->second.slot;
+        }
+        else {
+            auto target = live.find(id);
+            if (target == live.end()) {
+                result.skipped++;
+                continue;
+            }
+            record.size_class = target->second.size_class;
+            record.slot = target->second.slot;
+
+            if (op == __trace_op::copy_assign || op == __trace_op::move_assign) {
+                auto source = live.find(operand);
+                if (source == live.end() || source->second.size_class != record.size_class) {
+                    result.skipped++;
+                    continue;
+                }
+                record.source = source->second.slot;
+            }
+            else if (op == __trace_op::destroy) {
+                free_slots[record.size_class].push_back(record.slot);
+                live.erase(target);
+            }
+        }
+
+        if (op == __trace_op::create || op == __trace_op::copy_construct || op == __trace_op::move_construct) {
+            record.slot = new_slot(record.size_class);
+            live[id] = { record.size_class, record.slot };
+        }
+        result.ops.push_back(record);
+    }
+
+    return true;
+}
+
+
+// The configurations. allocator() gives the allocator each vector is constructed with.
+struct heap_vector {
+    static std::string name() { return "vector"; }
+    template<typename T> using container = std::vector<T>;
+    template<typename T> static std::allocator<T> allocator(std::monotonic_arena&) { return {}; }
+};
+
+template<size_t SZ> struct heap_sbo_vector {
+    static std::string name() { return "sbo_vector<" + std::to_string(SZ) + ">"; }
+    template<typename T> using container = std::sbo_vector<T, SZ>;
+    template<typename T> static std::buffered_allocator<T, SZ> allocator(std::monotonic_arena&) { return {}; }
+};
+
+struct arena_vector {
+    static std::string name() { return "arena vector"; }
+    template<typename T> using container = std::vector<T, std::monotonic_allocator<T>>;
+    template<typename T> static std::monotonic_allocator<T> allocator(std::monotonic_arena& arena) { return arena; }
+};
+
+template<size_t SZ> struct arena_sbo_vector {
+    static std::string name() { return "arena sbo_vector<" + std::to_string(SZ) + ">"; }
+    template<typename T> using container = std::sbo_vector<T, SZ, std::monotonic_allocator<T>>;
+    template<typename T> static std::buffered_allocator<T, SZ, std::monotonic_allocator<T>> allocator(std::monotonic_arena& arena) {
+        return std::monotonic_allocator<T>(arena);
+    }
+};
+
+
+// The vectors of one configuration and element size, indexed by slot.
+template<typename Config, typename T> class slot_table {
+public:
+    using container = typename Config::template container<T>;
+
+    slot_table(size_t slots, std::monotonic_arena& arena) : m_slots(new std::optional<container>[slots]), m_arena(arena) {}
+
+    void apply(const replay_op& op) {
+        std::optional<container>& v = m_slots[op.slot];
+        switch (op.op) {
+        case __trace_op::create:
+            v.emplace(Config::template allocator<T>(m_arena));
+            break;
+        case __trace_op::copy_construct:
+            v.emplace(*m_slots[op.source]);
+            break;
+        case __trace_op::move_construct:
+            v.emplace(std::move(*m_slots[op.source]));
+            break;
+        case __trace_op::destroy:
+            v.reset();
+            break;
+        case __trace_op::push_back:
+            v->push_back(T{});
+            break;
+        case __trace_op::pop_back:
+            if (!v->empty())        // Skipped records may have left the vector smaller than it was.
+                v->pop_back();
+            break;
+        case __trace_op::reserve:
+            v->reserve(op.operand);
+            break;
+        case __trace_op::resize:
+            v->resize(op.operand);
+            break;
+        case __trace_op::clear:
+            v->clear();
+            break;
+        case __trace_op::copy_assign:
+            if (op.source != op.slot)
+                *v = *m_slots[op.source];
+            break;
+        case __trace_op::move_assign:
+            if (op.source != op.slot)
+                *v = std::move(*m_slots[op.source]);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    std::unique_ptr<std::optional<container>[]> m_slots;
+    std::monotonic_arena& m_arena;
+};
+
+
+template<typename Config, size_t... Sizes> void replay(const trace& t, std::integer_sequence<size_t, Sizes...>)
+{
+    std::monotonic_arena arena;
+    std::optional<std::tuple<slot_table<Config, blob<Sizes>>...>> tables;
+    tables.emplace(slot_table<Config, blob<Sizes>>(t.slots[size_class_of(Sizes)], arena)...);
+
+    size_t allocations_before = heap_allocations.load();
+    size_t bytes_before = heap_bytes.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < t.ops.size(); i++) {
+        const replay_op& op = t.ops[i];
+        ((op.size_class == size_class_of(Sizes) ? std::get<slot_table<Config, blob<Sizes>>>(*tables).apply(op) : void()), ...);
+    }
+    tables.reset();     // Vectors still alive at the end of the trace.
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    size_t allocations = heap_allocations.load() - allocations_before;
+    size_t bytes = heap_bytes.load() - bytes_before;
+    std::printf("%-24s %12.3f %12.1f %16zu %16zu\n", Config::name().c_str(), elapsed.count() * 1e3,
+                elapsed.count() * 1e9 / double(std::max<size_t>(t.ops.size(), 1)), allocations, bytes);
+}
+
+template<typename Config> void run(const trace& t, int argc, char** argv)
+{
+    std::string name = Config::name();
+    bool selected = argc <= 2;
+    for (int i = 2; i < argc; i++)
+        selected = selected || name.find(argv[i]) != std::string::npos;
+
+    if (selected)
+        replay<Config>(t, size_classes());
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s trace.bin [configuration...]\n", argv[0]);
+        return 2;
+    }
+
+    trace t;
+    if (!read_trace(argv[1], t))
+        return 1;
+
+    std::printf("%zu records, %zu replayed", t.records, t.ops.size());
+    if (t.skipped != 0)
+        std::printf(", %zu skipped as their vectors were constructed before the trace started", t.skipped);
+    if (t.oversized != 0)
+        std::printf(", %zu vectors with elements larger than %zu bytes replayed with smaller ones", t.oversized,
+                    size_t(1) << (size_class_count - 1));
+    std::printf("\n\n%-24s %12s %12s %16s %16s\n", "configuration", "ms", "ns/op", "heap allocations", "heap bytes");
+
+    run<heap_vector>(t, argc, argv);
+    run<heap_sbo_vector<4>>(t, argc, argv);
+    run<heap_sbo_vector<8>>(t, argc, argv);
+    run<heap_sbo_vector<16>>(t, argc, argv);
+    run<heap_sbo_vector<32>>(t, argc, argv);
+    run<heap_sbo_vector<64>>(t, argc, argv);
+    run<arena_vector>(t, argc, argv);
+    run<arena_sbo_vector<16>>(t, argc, argv);
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+/// Allocator adaptor which samples allocations with their stack traces, to find out which code paths make sbo_vectors spill.
+/// Use it as the Backing allocator of buffered_allocator. Like tcmalloc it samples one allocation per sampling interval bytes
+/// on average, with exponentially distributed distances so that the samples form a Poisson process which pprof can unsample.
+///
+/// write_heap_profile() writes the legacy gperftools heap profile format which pprof reads, with both in-use and allocated
+/// counts. If the environment variable P2667_HEAP_PROFILE names a file the profile is also written there at exit. Stack
+/// traces need <execinfo.h>, elsewhere all samples get an empty stack.
+
+#include "experimental_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#endif
+
+namespace std {
+namespace detail {
+
+struct __heap_stack {
+    static constexpr int max_depth = 32;
+    void* frames[max_depth];
+    int depth = 0;
+
+    friend bool operator<(const __heap_stack& lhs, const __heap_stack& rhs) {
+        return lexicographical_compare(lhs.frames, lhs.frames + lhs.depth, rhs.frames, rhs.frames + rhs.depth);
+    }
+};
+
+struct __heap_sample_counts {
+    size_t alloc_count = 0;
+    size_t alloc_bytes = 0;
+    size_t inuse_count = 0;
+    size_t inuse_bytes = 0;
+};
+
+
+class __heap_sampler {
+public:
+    // Never destroyed, blocks may be deallocated during program exit.
+    static __heap_sampler& instance() {
+        static __heap_sampler& sampler = *new __heap_sampler;
+        return sampler;
+    }
+
+    size_t interval() const { return m_interval.load(memory_order_relaxed); }
+    void set_interval(size_t bytes) { m_interval.store(max<size_t>(bytes, 1), memory_order_relaxed); }
+
+    // Called for every allocation, only takes a lock if it decides to sample.
+    void note_allocation(const void* p, size_t bytes) {
+        __countdown& countdown = s_countdown;
+        size_t mean = interval();
+        if (countdown.mean != mean) {       // First use in this thread, or the interval was changed.
+            countdown.mean = mean;
+            countdown.remaining = countdown.next_distance();
+        }
+
+        countdown.remaining -= ptrdiff_t(bytes);
+        if (countdown.remaining > 0)
+            return;
+
+        countdown.remaining = countdown.next_distance();
+        record(p, bytes);
+    }
+
+    void note_deallocation(const void* p) {
+        if (m_liveSamples.load(memory_order_relaxed) == 0)
+            return;
+
+        live_shard& shard = m_shards[shard_of(p)];
+        lock_guard<mutex> shard_lock(shard.mutex);
+        auto it = shard.live.find(p);
+        if (it == shard.live.end())
+            return;
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            it->second.first->inuse_count--;
+            it->second.first->inuse_bytes -= it->second.second;
+        }
+        shard.live.erase(it);
+        m_liveSamples.fetch_sub(1, memory_order_relaxed);
+    }
+
+    void write(ostream& out) {
+        lock_guard<mutex> lock(m_mutex);
+        __heap_sample_counts total;
+        for (auto& [stack, counts] : m_stacks) {
+            total.alloc_count += counts.alloc_count;
+            total.alloc_bytes += counts.alloc_bytes;
+            total.inuse_count += counts.inuse_count;
+            total.inuse_bytes += counts.inuse_bytes;
+        }
+
+        out << "heap profile: " << total.inuse_count << ": " << total.inuse_bytes << " [" << total.alloc_count << ": "
+            << total.alloc_bytes << "] @ heap_v2/" << interval() << '\n';
+        for (auto& [stack, counts] : m_stacks) {
+            out << counts.inuse_count << ": " << counts.inuse_bytes << " [" << counts.alloc_count << ": " << counts.alloc_bytes << "] @";
+            for (int i = 0; i < stack.depth; i++)
+                out << ' ' << stack.frames[i];
+            out << '\n';
+        }
+
+        // pprof needs the mappings to symbolize the addresses.
+        ifstream maps("/proc/self/maps");
+        if (maps) {
+            out << "\nMAPPED_LIBRARIES:\n";
+            out << maps.rdbuf();
+        }
+    }
+
+private:
+    // Bytes left to the next sample of this thread, drawn from an exponential distribution with the interval as mean.
+    struct __countdown {
+        __countdown() : state(uint64_t(chrono::steady_clock::now().time_since_epoch().count()) ^ uint64_t(uintptr_t(this))) {}
+
+        ptrdiff_t next_distance() {
+            state ^= state << 13;       // xorshift64, <random> is too heavy and includes <vector>
+            state ^= state >> 7;
+            state ^= state << 17;
+            double u = (double(state >> 11) + 1) / 9007199254740993.0;       // (0, 1]
+            return ptrdiff_t(-log(u) * double(mean)) + 1;
+        }
+
+        uint64_t state;
+        size_t mean = 0;
+        ptrdiff_t remaining = 0;
+    };
+
+    struct live_shard {
+        std::mutex mutex;
+        map<const void*, pair<__heap_sample_counts*, size_t>> live;
+    };
+
+    static constexpr size_t shard_count = 16;
+    static size_t shard_of(const void* p) { return (uintptr_t(p) >> 4) % shard_count; }
+
+    void record(const void* p, size_t bytes) {
+        __heap_stack stack;
+#if __has_include(<execinfo.h>)
+        void* frames[__heap_stack::max_depth + 2];
+        int depth = backtrace(frames, __heap_stack::max_depth + 2);
+        for (int i = 2; i < depth; i++)         // Skip record() and note_allocation()
+            stack.frames[stack.depth++] = frames[i];
+#endif
+
+        __heap_sample_counts* counts;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            counts = &m_stacks[stack];
+            counts->alloc_count++;
+            counts->alloc_bytes += bytes;
+            counts->inuse_count++;
+            counts->inuse_bytes += bytes;
+        }
+
+        live_shard& shard = m_shards[shard_of(p)];
+        lock_guard<mutex> shard_lock(shard.mutex);
+        shard.live[p] = { counts, bytes };
+        m_liveSamples.fetch_add(1, memory_order_relaxed);
+    }
+
+    static inline thread_local __countdown s_countdown;
+
+    atomic<size_t> m_interval{ 512 * 1024 };
+    atomic<size_t> m_liveSamples{};
+    mutex m_mutex;
+    map<__heap_stack, __heap_sample_counts> m_stacks;       // Nodes are stable, live blocks point at their counts.
+    live_shard m_shards[shard_count];
+};
+
+
+struct __heap_profile_at_exit {
+    ~__heap_profile_at_exit() {
+        if (const char* path = getenv("P2667_HEAP_PROFILE")) {
+            ofstream out(path);
+            __heap_sampler::instance().write(out);
+        }
+    }
+};
+
+inline __heap_profile_at_exit __heap_profile_at_exit_instance;
+
+}  // namespace detail
+
+
+// Mean number of bytes between samples, 512 kB by default. 1 samples every allocation.
+inline void set_heap_sampling_interval(size_t bytes) { detail::__heap_sampler::instance().set_interval(bytes); }
+inline size_t heap_sampling_interval() { return detail::__heap_sampler::instance().interval(); }
+
+inline void write_heap_profile(ostream& out) { detail::__heap_sampler::instance().write(out); }
+inline void write_heap_profile(const char* path) {
+    ofstream out(path);
+    write_heap_profile(out);
+}
+
+
+// Adaptor which reports the allocations of Alloc to the sampler and forwards everything else, including allocator_info traits.
+template<typename Alloc> class sampling_allocator {
+    using Traits = allocator_traits<Alloc>;
+public:
+    using value_type = Traits::value_type;
+    using pointer = Traits::pointer;
+    using const_pointer = Traits::const_pointer;
+    using void_pointer = Traits::void_pointer;
+    using const_void_pointer = Traits::const_void_pointer;
+    using difference_type = Traits::difference_type;
+    using size_type = Traits::size_type;
+
+    struct propagate_on_container_copy_assignment : Traits::propagate_on_container_copy_assignment {};
+    struct propagate_on_container_move_assignment : Traits::propagate_on_container_move_assignment {};
+    struct propagate_on_container_swap : Traits::propagate_on_container_swap {};
+    using is_always_equal = Traits::is_always_equal;
+
+    static constexpr size_type buffer_capacity = allocator_info::buffer_capacity<Alloc>;
+    static constexpr bool can_allocate = allocator_info::can_allocate<Alloc>;
+    static constexpr bool deallocate_is_noop = allocator_info::deallocate_is_noop<Alloc>;
+
+    template<typename U> struct rebind {
+        using other = sampling_allocator<typename Traits::template rebind_alloc<U>>;
+    };
+
+    template<typename... Args> requires is_constructible_v<Alloc, Args...>
+        sampling_allocator(Args&&... args) : m_alloc(forward<Args>(args)...) {}
+    template<typename A> sampling_allocator(const sampling_allocator<A>& src) : m_alloc(src.m_alloc) {}
+
+    pointer allocate(size_type count) {
+        pointer p = Traits::allocate(m_alloc, count);
+        detail::__heap_sampler::instance().note_allocation(to_address(p), count * sizeof(value_type));
+        return p;
+    }
+
+    allocation_result<pointer> allocate_at_least(size_type count) {
+        auto result = allocator_info::allocate_at_least(m_alloc, count);
+        detail::__heap_sampler::instance().note_allocation(to_address(result.ptr), result.count * sizeof(value_type));
+        return { result.ptr, result.count };
+    }
+
+    // Forget the sample before the block can be reused by another thread.
+    void deallocate(pointer p, size_type count) {
+        detail::__heap_sampler::instance().note_deallocation(to_address(p));
+        Traits::deallocate(m_alloc, p, count);
+    }
+
+    constexpr size_type max_size() const { return Traits::max_size(m_alloc); }
+
+    sampling_allocator select_on_container_copy_construction() const {
+        return sampling_allocator(Traits::select_on_container_copy_construction(m_alloc));
+    }
+
+    template<typename A> friend bool operator==(const sampling_allocator& lhs, const sampling_allocator<A>& rhs) { return lhs.m_alloc == rhs.m_alloc; }
+
+private:
+    template<typename A> friend class sampling_allocator;
+
+    [[no_unique_address]] Alloc m_alloc;
+};
+
+}  // namespace std
@@ -0,0 +1,94 @@
+#pragma once
+
+/// Per-thread scratch memory for temporary containers. Each thread has a monotonic_arena, a scratch_scope marks where it
+/// is when the scope starts and gives back everything allocated after that when it ends, and scratch_allocator allocates
+/// from the arena of the current thread. Allocation is a pointer bump and deallocation does nothing, so vector doesn't even
+/// call it.
+///
+///     void f() {
+///         std::scratch_scope scope;
+///         std::vector<int, std::scratch_allocator<int>> temp;
+///         std::sbo_vector<int, 16, std::scratch_allocator<int>> small;
+///         ...
+///     }
+///
+/// Containers using scratch_allocator must be destroyed before the innermost scope that was active while they allocated ends,
+/// and must stay on their thread. Growing a container of an outer scope inside an inner scope would put its new block in the
+/// inner scope, so scratch_allocator remembers the scope depth it was created at and asserts that it still is the depth when
+/// it allocates. Copied containers get an allocator of the current scope, and allocators of different scopes compare
+/// unequal, so that move assigning a container of an inner scope to one of an outer scope moves the elements instead of
+/// taking the block the inner scope gives back. Allocations outside of any scope are only given back when the thread exits.
+
+#include "experimental_memory.h"
+
+#include <cassert>
+
+namespace std {
+namespace detail {
+
+// Function local so that only threads which use scratch memory get an arena.
+inline monotonic_arena& __scratch_arena() {
+    static thread_local monotonic_arena arena(16384);
+    return arena;
+}
+
+// Number of scratch_scopes active on this thread.
+inline size_t& __scratch_depth() {
+    static thread_local size_t depth = 0;
+    return depth;
+}
+
+}  // namespace detail
+
+
+class scratch_scope {
+public:
+    scratch_scope() : m_mark(detail::__scratch_arena().mark()) { detail::__scratch_depth()++; }
+    ~scratch_scope() {
+        detail::__scratch_depth()--;
+        detail::__scratch_arena().rewind(m_mark);
+    }
+    scratch_scope(const scratch_scope&) = delete;
+    scratch_scope& operator=(const scratch_scope&) = delete;
+
+private:
+    monotonic_arena::marker m_mark;
+};
+
+
+// Allocator using the scratch arena of the current thread. Its only state is the scope depth it was created at, and it is
+// equal to the allocators of the same depth.
+template<typename T> class scratch_allocator {
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using is_always_equal = false_type;
+
+    constexpr static bool deallocate_is_noop = true;
+
+    scratch_allocator() : m_depth(detail::__scratch_depth()) {}
+    template<typename U> scratch_allocator(const scratch_allocator<U>& src) : m_depth(src.depth()) {}
+
+    scratch_allocator select_on_container_copy_construction() const { return scratch_allocator(); }
+
+    size_t depth() const { return m_depth; }
+
+    T* allocate(size_type count) {
+        assert(detail::__scratch_depth() == m_depth && "scratch container allocating in another scope than its own");
+        if (count > max_size())
+            throw bad_array_new_length();
+
+        return static_cast<T*>(detail::__scratch_arena().allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_type) {}
+
+    static constexpr size_type max_size() { return size_type(-1) / sizeof(T); }
+
+    friend bool operator==(const scratch_allocator& a, const scratch_allocator& b) { return a.m_depth == b.m_depth; }
+
+private:
+    size_t m_depth;
+};
+
+}  // namespace std
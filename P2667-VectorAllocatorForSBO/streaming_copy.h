@@ -0,0 +1,87 @@
+#pragma once
+
+/// Copying of the elements of vectors of trivially relocatable elements. Copies of at least the streaming copy threshold
+/// bytes use non-temporal stores, which write around the cache, and non-temporal prefetches of the source, so that copying a
+/// vector of hundreds of megabytes doesn't evict the working set of the rest of the program. Smaller copies use memcpy, as
+/// the copy is then likely to be read soon and non-temporal stores only pay off for data which doesn't fit in the cache.
+///
+/// Define P2667_STREAMING_COPY_THRESHOLD to set the default threshold in bytes, or call std::set_streaming_copy_threshold().
+/// Non-temporal stores are used with AVX or SSE2, whichever the translation unit is compiled for, other targets use memcpy.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#ifndef P2667_STREAMING_COPY_THRESHOLD
+#define P2667_STREAMING_COPY_THRESHOLD (size_t(16) << 20)
+#endif
+
+namespace std {
+namespace detail {
+
+inline atomic<size_t>& __streaming_copy_threshold() {
+    static atomic<size_t> threshold{ P2667_STREAMING_COPY_THRESHOLD };
+    return threshold;
+}
+
+// Copy with non-temporal stores of whole vectors to aligned destinations, and memcpy for the unaligned head and the tail.
+inline void __copy_streaming(void* dest, const void* src, size_t bytes) {
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#if defined(__AVX__)
+    using chunk = __m256i;
+#else
+    using chunk = __m128i;
+#endif
+    constexpr size_t prefetch_distance = 512;
+
+    char* to = static_cast<char*>(dest);
+    const char* from = static_cast<const char*>(src);
+    size_t head = min((sizeof(chunk) - reinterpret_cast<uintptr_t>(to) % sizeof(chunk)) % sizeof(chunk), bytes);
+    memcpy(to, from, head);
+    to += head;
+    from += head;
+    bytes -= head;
+
+    for (; bytes >= sizeof(chunk); bytes -= sizeof(chunk), to += sizeof(chunk), from += sizeof(chunk)) {
+        if (reinterpret_cast<uintptr_t>(from) % 64 < sizeof(chunk))
+            _mm_prefetch(from + prefetch_distance, _MM_HINT_NTA);
+#if defined(__AVX__)
+        _mm256_stream_si256(reinterpret_cast<chunk*>(to), _mm256_loadu_si256(reinterpret_cast<const chunk*>(from)));
+#else
+        _mm_stream_si128(reinterpret_cast<chunk*>(to), _mm_loadu_si128(reinterpret_cast<const chunk*>(from)));
+#endif
+    }
+    _mm_sfence();       // Non-temporal stores are weakly ordered.
+    memcpy(to, from, bytes);
+#else
+    memcpy(dest, src, bytes);
+#endif
+}
+
+// memmove for the elements of vectors: dest and src may be the same but are otherwise distinct blocks.
+inline void __copy_elements(void* dest, const void* src, size_t bytes) {
+    if (dest == src || bytes == 0)
+        return;
+
+    if (bytes >= __streaming_copy_threshold().load(memory_order_relaxed))
+        __copy_streaming(dest, src, bytes);
+    else
+        memcpy(dest, src, bytes);
+}
+
+}  // namespace detail
+
+
+// Set the size in bytes from which vector copies of trivially relocatable elements bypass the cache. Returns the previous
+// threshold. size_t(-1) turns streaming copies off.
+inline size_t set_streaming_copy_threshold(size_t bytes) {
+    return detail::__streaming_copy_threshold().exchange(bytes, memory_order_relaxed);
+}
+
+}  // namespace std
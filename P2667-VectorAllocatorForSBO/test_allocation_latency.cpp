@@ -0,0 +1,79 @@
+// The latency mode changes vector, so it is tested in its own program.
+#define P2667_ALLOCATION_LATENCY
+#include "experimental_vector.h"
+
+#include <cassert>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+// Backing allocator which takes at least 50 us per allocation.
+template<typename T> struct slow_allocator : std::allocator<T> {
+    template<typename U> struct rebind {
+        using other = slow_allocator<U>;
+    };
+
+    slow_allocator() = default;
+    template<typename U> slow_allocator(const slow_allocator<U>&) {}
+
+    T* allocate(size_t count) {
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(50);
+        while (std::chrono::steady_clock::now() < until)
+            ;
+        return std::allocator<T>::allocate(count);
+    }
+};
+
+int main()
+{
+    using histogram = std::detail::__latency_histogram;
+
+    // Each bucket's highest value maps back to the bucket, and the next value to the next bucket.
+    for (size_t i = 0; i + 1 < histogram::bucket_count; i++) {
+        assert(histogram::index_of(histogram::value_of(i)) == i);
+        assert(histogram::index_of(histogram::value_of(i) + 1) == i + 1);
+    }
+    assert(histogram::index_of(~uint64_t(0)) == histogram::bucket_count - 1);
+
+    // Allocations from two threads are counted together.
+    auto grow = [] {
+        for (int i = 0; i < 10; i++) {
+            std::sbo_vector<int, 4, slow_allocator<int>> v;
+            for (int j = 0; j < 8; j++)     // Gets the buffer, then grows to 6 and 9 elements from slow_allocator.
+                v.push_back(j);
+        }
+    };
+    std::thread other(grow);
+    grow();
+    other.join();
+
+    std::ostringstream out;
+    std::allocation_latency_report(out);
+
+    std::istringstream lines(out.str());
+    std::string line;
+    bool found_allocate = false, found_deallocate = false;
+    while (std::getline(lines, line)) {
+        if (line[0] == '#' || line.find("slow_allocator") == std::string::npos)
+            continue;
+
+        std::istringstream fields(line);
+        std::string type, op;
+        uint64_t calls, p50, p99, p999, max;
+        std::getline(fields, type, '\t');
+        std::getline(fields, op, '\t');
+        fields >> calls >> p50 >> p99 >> p999 >> max;
+        assert(p50 <= p99 && p99 <= p999 && p999 <= max);
+
+        if (op == "allocate_at_least") {
+            found_allocate = true;
+            assert(calls == 60);
+            assert(p50 >= 45000);       // Allow for the resolution of the histogram and the clock calibration.
+        }
+        else if (op == "deallocate") {
+            found_deallocate = true;
+            assert(calls == 60);
+        }
+    }
+    assert(found_allocate && found_deallocate);
+}
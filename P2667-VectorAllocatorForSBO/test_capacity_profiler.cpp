@@ -0,0 +1,66 @@
+// The profiling mode changes vector, so it is tested in its own program.
+#define P2667_PROFILE_CAPACITY
+#include "experimental_vector.h"
+
+#include <cassert>
+#include <sstream>
+
+int main()
+{
+    // Peak sizes 0 to 9, ten vectors each.
+    unsigned loop_line = 0;
+    for (int i = 0; i < 100; i++) {
+        std::sbo_vector<int, 4> v;
+        loop_line = std::source_location::current().line() - 1;
+        for (int j = 0; j < i % 10; j++)
+            v.push_back(j);
+    }
+
+    // The peak counts, even if the vector is emptied before it dies.
+    for (int i = 0; i < 10; i++) {
+        std::vector<double> v;
+        v.resize(20);
+        v.clear();
+    }
+
+    std::ostringstream out;
+    std::capacity_profile_report(out, 0.9);
+    std::string report = out.str();
+
+    std::istringstream lines(report);
+    std::string line;
+    int sites = 0;
+    while (std::getline(lines, line)) {
+        if (line[0] == '#')
+            continue;
+
+        sites++;
+        std::istringstream fields(line);
+        std::string site, type, vectors, element_size, current, mean_final, max_peak, max_capacity, recommended, final_sizes, peak_sizes,
+                    capacities;
+        std::getline(fields, site, '\t');
+        std::getline(fields, type, '\t');
+        fields >> vectors >> element_size >> current >> mean_final >> max_peak >> max_capacity >> recommended >> final_sizes >> peak_sizes
+               >> capacities;
+
+        if (site.find(":" + std::to_string(loop_line) + ":") != std::string::npos) {
+            assert(vectors == "100");
+            assert(current == "4");
+            assert(max_peak == "9");
+            assert(recommended == "8");
+            assert(final_sizes == "0:10,1:10,2:10,3:10,4:10,5:10,6:10,7:10,8:10,9:10");
+            assert(peak_sizes == final_sizes);
+            assert(capacities.substr(0, 10) == "0:10,4:40,");  // Empty, and kept in the buffer
+        }
+        else {
+            assert(vectors == "10");
+            assert(element_size == "8");
+            assert(mean_final == "0");
+            assert(max_peak == "20");
+            assert(final_sizes == "0:10");
+            assert(peak_sizes == "20:10");
+            assert(capacities == max_capacity + ":10");
+        }
+    }
+    assert(sites == 2);
+}
@@ -0,0 +1,224 @@
+// Checks that static_vector, and sbo_vector while it stays in its buffer, never allocate, by replacing the global
+// operator new and, with glibc, malloc with versions that count calls. As that affects the whole program it is a program
+// of its own.
+
+#include "experimental_vector.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+int failures = 0;
+
+void* counted_new(size_t size)
+{
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* counted_aligned_new(size_t size, std::align_val_t alignment)
+{
+    allocations++;
+    size_t align = size_t(alignment);
+#ifdef _MSC_VER
+    if (void* p = _aligned_malloc(size ? size : 1, align))
+        return p;
+#else
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align))
+        return p;
+#endif
+    throw std::bad_alloc();
+}
+
+void aligned_free(void* p)
+{
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+}  // namespace
+
+
+void* operator new(size_t size) { return counted_new(size); }
+void* operator new[](size_t size) { return counted_new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { try { return counted_new(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { try { return counted_new(size); } catch (...) { return nullptr; } }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_aligned_new(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_aligned_new(size, alignment); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+
+
+// Catch direct malloc calls too where the C library lets us. Sanitizers replace malloc themselves.
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define P2667_COUNT_MALLOC 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define P2667_COUNT_MALLOC 0
+#endif
+#endif
+#if !defined(P2667_COUNT_MALLOC) && defined(__GLIBC__)
+#define P2667_COUNT_MALLOC 1
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+
+void* malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+void* realloc(void* p, size_t size)
+{
+    allocations++;
+    return __libc_realloc(p, size);
+}
+}
+#endif
+#ifndef P2667_COUNT_MALLOC
+#define P2667_COUNT_MALLOC 0
+#endif
+
+
+namespace {
+
+template<typename F> void expect_no_allocation(const char* container, const char* operation, F f)
+{
+    size_t before = allocations.load();
+    f();
+    size_t count = allocations.load() - before;
+    if (count != 0) {
+        std::printf("FAIL: %s %s allocated %zu times\n", container, operation, count);
+        failures++;
+    }
+}
+
+#define EXPECT_NO_ALLOCATION(statement) expect_no_allocation(name, #statement, [&] { statement; })
+
+
+// Element with its own copy, move and destructor, so that the containers can't take the memcpy paths of trivially
+// relocatable elements.
+struct element {
+    int value = 0;
+
+    element() = default;
+    element(int v) : value(v) {}
+    element(const element& src) : value(src.value) {}
+    element(element&& src) noexcept : value(src.value) { src.value = -1; }
+    element& operator=(const element& src) { value = src.value; return *this; }
+    element& operator=(element&& src) noexcept { value = src.value; src.value = -1; return *this; }
+    ~element() { value = -2; }
+};
+
+// Every member of vector, on containers which are to stay within their SZ = 8 elements. Other is a container of another
+// allocator type which also doesn't allocate. vector has no swap, insert or emplace.
+template<typename C, typename Other> void test_members(const char* name)
+{
+    using T = typename C::value_type;
+    using A = typename C::allocator_type;
+    alignas(C) unsigned char storage[sizeof(C)];
+    C* constructed = nullptr;
+    EXPECT_NO_ALLOCATION(constructed = new (storage) C());
+    EXPECT_NO_ALLOCATION(constructed->~C());
+    EXPECT_NO_ALLOCATION(constructed = new (storage) C(A()));
+    EXPECT_NO_ALLOCATION(constructed->~C());
+    EXPECT_NO_ALLOCATION(constructed = new (storage) C(5));
+    EXPECT_NO_ALLOCATION(constructed->~C());
+    EXPECT_NO_ALLOCATION(constructed = new (storage) C(8, A()));
+    EXPECT_NO_ALLOCATION(constructed->~C());
+
+    C v;
+    EXPECT_NO_ALLOCATION(v.reserve(8));
+    for (int i = 0; i < 6; i++)
+        EXPECT_NO_ALLOCATION(v.push_back(T(i)));
+    EXPECT_NO_ALLOCATION(v.pop_back());
+    EXPECT_NO_ALLOCATION(v.resize(8));
+    EXPECT_NO_ALLOCATION(v.resize(3));
+    EXPECT_NO_ALLOCATION(v.shrink_to_fit());
+    EXPECT_NO_ALLOCATION((void)v.size());
+    EXPECT_NO_ALLOCATION((void)v.capacity());
+    EXPECT_NO_ALLOCATION((void)v.empty());
+    EXPECT_NO_ALLOCATION((void)v.data());
+    EXPECT_NO_ALLOCATION((void)static_cast<const C&>(v).data());
+    EXPECT_NO_ALLOCATION((void)v[1]);
+    EXPECT_NO_ALLOCATION((void)static_cast<const C&>(v)[1]);
+    EXPECT_NO_ALLOCATION((void)v.begin());
+    EXPECT_NO_ALLOCATION((void)v.end());
+    EXPECT_NO_ALLOCATION((void)v.get_allocator());
+
+    EXPECT_NO_ALLOCATION(C copy(v));
+    EXPECT_NO_ALLOCATION(C moved(std::move(C(v))));
+    EXPECT_NO_ALLOCATION(C copy(v, v.get_allocator()));
+    EXPECT_NO_ALLOCATION(C moved(std::move(C(v)), v.get_allocator()));
+
+    C target;
+    EXPECT_NO_ALLOCATION(target = v);
+    EXPECT_NO_ALLOCATION(target = std::move(v));
+
+    Other other;
+    other.push_back(T(7));
+    EXPECT_NO_ALLOCATION(C converted(other));
+    EXPECT_NO_ALLOCATION(C converted(std::move(Other(other))));
+    EXPECT_NO_ALLOCATION(target = other);
+    EXPECT_NO_ALLOCATION(target = std::move(other));
+
+    EXPECT_NO_ALLOCATION(target.clear());
+}
+
+}  // namespace
+
+
+int main()
+{
+    using std::allocator_info::never_allocates;
+    static_assert(never_allocates<std::static_vector<int, 8>>);
+    static_assert(never_allocates<std::static_vector_throw<int, 8>>);
+    static_assert(!never_allocates<std::sbo_vector<int, 8>>);
+    static_assert(!never_allocates<std::vector<int>>);
+
+    test_members<std::static_vector<int, 8>, std::sbo_vector<int, 8>>("static_vector<int, 8>");
+    test_members<std::sbo_vector<int, 8>, std::static_vector<int, 8>>("sbo_vector<int, 8>");
+    test_members<std::sbo_vector<int, 8>, std::sbo_vector<int, 16>>("sbo_vector<int, 8>");
+    test_members<std::static_vector<element, 8>, std::sbo_vector<element, 8>>("static_vector<element, 8>");
+    test_members<std::sbo_vector<element, 8>, std::static_vector<element, 8>>("sbo_vector<element, 8>");
+    test_members<std::sbo_vector<element, 8>, std::sbo_vector<element, 16>>("sbo_vector<element, 8>");
+
+    // The counting itself works: spilling out of the buffer allocates.
+    size_t before = allocations.load();
+    {
+        std::sbo_vector<int, 8> spilled;
+        for (int i = 0; i < 9; i++)
+            spilled.push_back(i);
+    }
+    if (allocations.load() == before) {
+        std::printf("FAIL: allocations are not counted\n");
+        failures++;
+    }
+
+    std::printf("%s, malloc %s\n", failures ? "FAILED" : "OK", P2667_COUNT_MALLOC ? "counted" : "not counted");
+    return failures ? 1 : 0;
+}
@@ -1,3 +1,6 @@
+#include <cstddef>
+
+using std::size_t;
 
 template <typename T, size_t N>
 constexpr size_t array_size(T(&)[N]) {
@@ -7,12 +10,700 @@ constexpr size_t array_size(T(&)[N]) {
 void check(int const (&param)[3]) {
     int local[] = { 1, 2, 3 };
     constexpr auto s0 = array_size(local); // ok
+#ifdef _MSC_VER
     constexpr auto s1 = array_size(param); // error
+#endif
 }
 
 #include "experimental_vector.h"
+#ifdef P2667_HAS_PMR
+#include "experimental_memory_resource.h"
+#endif
+#include "allocation_stats.h"
+#include "sampling_allocator.h"
+#include "scratch_allocator.h"
+#include "thread_caching_allocator.h"
+#ifdef __linux__
+#include "mmap_allocator.h"
+#endif
 
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <scoped_allocator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+void test_buffered_node_allocator()
+{
+    alignas(std::max_align_t) std::byte storage[4][256];
+
+    // The first nodes live in the arena, the rest spill to the backing allocator.
+    std::node_arena list_arena(storage[0], sizeof(storage[0]));
+    using list_alloc = std::buffered_node_allocator<int>;
+    std::list<int, list_alloc> l{list_alloc(list_arena)};
+    for (int i = 0; i < 20; i++)
+        l.push_back(i);
+    assert(l.size() == 20);
+    assert(l.front() == 0 && l.back() == 19);
+    assert(list_arena.contains(&l.front()) && !list_arena.contains(&l.back()));
+
+    // Released slots are reused.
+    l.clear();
+    l.push_back(0);
+    assert(list_arena.contains(&l.front()));
+
+    // Copies and rebound copies share the arena and compare equal.
+    list_alloc a1(l.get_allocator());
+    assert(a1 == l.get_allocator());
+    std::buffered_node_allocator<double> rebound(a1);
+    assert(rebound == a1 && rebound.arena() == &list_arena);
+    assert(list_alloc() != a1);
+
+    // Moved containers keep their nodes in the arena and release them there, as do splices and swaps.
+    for (int i = 1; i < 20; i++)
+        l.push_back(i);
+    std::list<int, list_alloc> moved(std::move(l));
+    assert(moved.size() == 20 && moved.front() == 0);
+    std::list<int, list_alloc> other{list_alloc(list_arena)};
+    other.splice(other.end(), moved, moved.begin(), std::next(moved.begin(), 10));
+    assert(other.size() == 10 && moved.size() == 10);
+    std::list<int, list_alloc> heap_backed;
+    heap_backed.swap(other);
+    assert(heap_backed.size() == 10 && other.empty());
+    moved = std::move(heap_backed);
+    assert(moved.size() == 10 && moved.get_allocator().arena() == &list_arena);
+    moved.clear();
+
+    std::node_arena map_arena(storage[1], sizeof(storage[1]));
+    using map_alloc = std::buffered_node_allocator<std::pair<const int, int>>;
+    std::map<int, int, std::less<int>, map_alloc> m{map_alloc(map_arena)};
+    for (int i = 0; i < 20; i++)
+        m[i] = i * i;
+    for (int i = 0; i < 20; i += 2)
+        m.erase(i);
+    assert(m.size() == 10);
+    assert(m[3] == 9);
+    std::map<int, int, std::less<int>, map_alloc> moved_map(std::move(m));
+    moved_map.erase(3);
+    assert(moved_map.size() == 9 && moved_map[5] == 25);
+    moved_map.clear();
+
+    // The bucket arrays of unordered_map come from the backing allocator.
+    std::node_arena unordered_arena(storage[2], sizeof(storage[2]));
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, map_alloc> um{map_alloc(unordered_arena)};
+    for (int i = 0; i < 20; i++)
+        um[i] = i;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, map_alloc> moved_um(std::move(um));
+    for (int i = 0; i < 20; i += 2)
+        moved_um.erase(i);
+    assert(moved_um.size() == 10 && moved_um.at(7) == 7);
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, map_alloc> swapped;
+    swapped.swap(moved_um);
+    assert(swapped.size() == 10 && swapped.get_allocator().arena() == &unordered_arena);
+    swapped.clear();
+
+    // Without a backing allocator able to allocate this is a fixed size node pool.
+    std::node_arena fixed_arena(storage[3], 2 * sizeof(void*));
+    std::buffered_node_allocator<void*, std::throwing_allocator<void*>> fixed(fixed_arena);
+    void** a = fixed.allocate(1);
+    void** b = fixed.allocate(1);
+    bool threw = false;
+    try { (void) fixed.allocate(1); } catch (const std::bad_alloc&) { threw = true; }
+    assert(threw);
+    fixed.deallocate(a, 1);
+    assert(fixed.allocate(1) == a);
+    fixed.deallocate(b, 1);
+}
+
+void test_monotonic_allocator()
+{
+    std::monotonic_arena arena(256);
+    std::monotonic_allocator<int> alloc(arena);
+    static_assert(std::allocator_info::deallocate_is_noop<std::monotonic_allocator<int>>);
+    static_assert(std::allocator_info::deallocate_is_noop<std::buffered_allocator<int, 4, std::monotonic_allocator<int>>>);
+
+    int* first = alloc.allocate(1);
+    {
+        std::vector<int, std::monotonic_allocator<int>> v(alloc);
+        for (int i = 0; i < 100; i++)
+            v.push_back(i);
+        assert(v.size() == 100);
+        assert(v[99] == 99);
+
+        // Spills of the buffered vector also end up in the arena.
+        std::sbo_vector<int, 4, std::monotonic_allocator<int>> sbo(alloc);
+        for (int i = 0; i < 10; i++)
+            sbo.push_back(i);
+        assert(sbo[9] == 9);
+    }
+
+    // After reset the same memory is handed out again.
+    arena.reset();
+    assert(alloc.allocate(1) == first);
+
+    // Filling an oversized chunk, whose end is not aligned, and then asking for a more aligned block moves to a new chunk.
+    std::monotonic_arena small(16);
+    char* odd = static_cast<char*>(small.allocate(17, 1));
+    std::memset(odd, 1, 17);
+    double* aligned = static_cast<double*>(small.allocate(sizeof(double), alignof(double)));
+    assert(reinterpret_cast<std::uintptr_t>(aligned) % alignof(double) == 0);
+    assert(aligned < reinterpret_cast<double*>(odd) || aligned >= reinterpret_cast<double*>(odd + 17));
+    *aligned = 1.0;
+    assert(odd[16] == 1);
+}
+
+void test_thread_caching_allocator()
+{
+    std::thread_caching_allocator<int> alloc;
+
+    // The full size class is reported as capacity.
+    auto result = std::allocate_at_least(alloc, 5);
+    assert(result.count == 8);
+    alloc.deallocate(result.ptr, result.count);
+    assert(alloc.allocate(8) == result.ptr);       // Reused from the thread cache
+    alloc.deallocate(result.ptr, 8);
+
+    std::sbo_vector<int, 4, std::thread_caching_allocator<int>> v;
+    for (int i = 0; i < 1000; i++)
+        v.push_back(i);
+    assert(v.capacity() >= 1000);
+    assert(v[999] == 999);
+
+    // Blocks allocated on one thread can be released on another.
+    int* p = alloc.allocate(100);
+    std::thread([&] { alloc.deallocate(p, 100); }).join();
+}
+
+#ifdef P2667_HAS_PMR
+// Resource bumping through a fixed buffer, to see where allocations end up.
+class fixed_resource : public std::pmr::memory_resource {
+public:
+    bool owns(const void* p) const { return p >= m_data && p < m_data + sizeof(m_data); }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        m_used = (m_used + alignment - 1) / alignment * alignment;
+        if (m_used + bytes > sizeof(m_data))
+            throw std::bad_alloc();
+
+        m_used += bytes;
+        return m_data + m_used - bytes;
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+
+    alignas(std::max_align_t) std::byte m_data[4096];
+    size_t m_used = 0;
+};
+
+void test_pmr()
+{
+    using pmr_alloc = std::pmr::polymorphic_allocator<int>;
+    fixed_resource arena, other;
+
+    // Spills go to the resource of the polymorphic_allocator.
+    std::sbo_vector<int, 4, pmr_alloc> sbo{pmr_alloc(&arena)};
+    for (int i = 0; i < 100; i++)
+        sbo.push_back(i);
+    assert(sbo[99] == 99);
+    assert(arena.owns(sbo.data()));
+
+    // Moving to a vector with the same backing keeps the resource.
+    std::vector<int, pmr_alloc> v(std::move(sbo));
+    assert(v.size() == 100 && sbo.empty());
+    v.push_back(100);
+    assert(arena.owns(v.data()));
+
+    // Comparison and propagation follow the backing polymorphic_allocator.
+    std::buffered_allocator<int, 4, pmr_alloc> a(&arena), b(&arena), c(&other);
+    assert(a == b);
+    assert(!(a == c));
+    static_assert(!std::allocator_traits<decltype(a)>::propagate_on_container_move_assignment::value);
+    assert(std::allocator_traits<decltype(a)>::select_on_container_copy_construction(a) == pmr_alloc());
+
+    // A buffered_resource hands its whole buffer to the first vector using it.
+    std::pmr::buffered_resource<256> inline_resource(&arena);
+    std::vector<int, pmr_alloc> in_buffer{pmr_alloc(&inline_resource)};
+    in_buffer.push_back(1);
+    assert(in_buffer.capacity() == 256 / sizeof(int));
+    assert(!arena.owns(in_buffer.data()));
+    for (int i = 0; i < 100; i++)
+        in_buffer.push_back(i);
+    assert(in_buffer.size() == 101 && in_buffer[100] == 99);
+    assert(arena.owns(in_buffer.data()));
+}
+#endif
+
+struct stats_test_tag {};
+
+void test_stats_allocator()
+{
+    using counted = std::stats_allocator<std::thread_caching_allocator<int>, stats_test_tag>;
+    static_assert(!std::allocator_info::can_allocate<std::stats_allocator<std::throwing_allocator<int>>>);
+
+    std::allocation_stats before = std::allocation_statistics<stats_test_tag>();
+    {
+        std::sbo_vector<int, 4, counted> small;
+        for (int i = 0; i < 4; i++)
+            small.push_back(i);
+
+        std::sbo_vector<int, 4, counted> large;
+        for (int i = 0; i < 100; i++)
+            large.push_back(i);
+
+        std::allocation_stats during = std::allocation_statistics<stats_test_tag>() - before;
+        assert(during.spills == 1);             // Only large left its buffer
+        assert(during.allocations > 1);
+        assert(during.live_bytes() >= 100 * sizeof(int));
+        assert(during.slack_bytes > 0);         // The size classes round up
+    }
+
+    // Allocations on other threads are included once they have exited.
+    std::thread([] { counted().deallocate(counted().allocate(10), 10); }).join();
+
+    std::allocation_stats after = std::allocation_statistics<stats_test_tag>() - before;
+    assert(after.live_bytes() == 0);
+    assert(after.allocations == after.deallocations);
+    assert(after.spills == 2);
+    assert(after.peak_bytes >= 100 * sizeof(int));
+}
+
+void test_sampling_allocator()
+{
+    size_t interval = std::heap_sampling_interval();
+    std::set_heap_sampling_interval(1);         // Sample everything
+
+    std::ostringstream during;
+    {
+        std::sbo_vector<int, 4, std::sampling_allocator<std::allocator<int>>> v;
+        for (int i = 0; i < 100; i++)
+            v.push_back(i);
+
+        std::vector<int, std::sampling_allocator<std::allocator<int>>> other;
+        other.push_back(1);
+        std::write_heap_profile(during);
+    }
+    std::ostringstream after;
+    std::write_heap_profile(after);
+    std::set_heap_sampling_interval(interval);
+
+    // Two vectors have one block each in use, v has made a number of allocations.
+    std::string profile = during.str();
+    assert(profile.rfind("heap profile: 2: ", 0) == 0);
+    assert(profile.find("] @ heap_v2/1\n") != std::string::npos);
+    assert(after.str().rfind("heap profile: 0: 0 [", 0) == 0);
+}
+
+void test_copy_and_move()
+{
+    // Strings make ASan catch double destruction.
+    std::sbo_vector<std::string, 4> heap;
+    for (int i = 0; i < 10; i++)
+        heap.push_back(std::to_string(i));
+
+    std::sbo_vector<std::string, 4> copy(heap);
+    assert(copy.size() == 10 && copy[9] == "9" && copy.data() != heap.data());
+    copy = heap;
+    assert(copy.size() == 10 && heap.size() == 10);
+
+    const std::static_vector<int, 8> fixed = [] {
+        std::static_vector<int, 8> v;
+        v.push_back(7);
+        return v;
+    }();
+    std::static_vector<int, 8> fixed_copy(fixed);
+    assert(fixed_copy.size() == 1 && fixed_copy[0] == 7);
+
+    // Same type: The heap block is taken over.
+    const std::string* block = heap.data();
+    std::sbo_vector<std::string, 4> moved(std::move(heap));
+    assert(moved.data() == block && heap.size() == 0);
+
+    // The source's inline buffer can't be taken over even if the destination needs to allocate.
+    std::sbo_vector<int, 16> large_buffer;
+    for (int i = 0; i < 10; i++)
+        large_buffer.push_back(i);
+    std::sbo_vector<int, 4> small_buffer(std::move(large_buffer));
+    assert(small_buffer.size() == 10 && small_buffer[9] == 9 && large_buffer.size() == 0);
+    large_buffer.push_back(42);
+    assert(small_buffer[0] == 0);
+}
+
+void test_trivially_relocatable()
+{
+    struct point {
+        int x, y, z;
+    };
+    static_assert(std::detail::__trivially_relocatable<point, std::allocator<point>>);
+    static_assert(std::detail::__trivially_relocatable<point, std::buffered_allocator<point, 4, std::monotonic_allocator<point>>>);
+    static_assert(!std::detail::__trivially_relocatable<std::string, std::allocator<std::string>>);
+#ifdef P2667_HAS_PMR
+    static_assert(!std::detail::__trivially_relocatable<int, std::pmr::polymorphic_allocator<int>>);     // Has construct.
+#endif
+
+    // Growth through the shared core, out of the buffer and on the heap.
+    std::sbo_vector<point, 4> v;
+    for (int i = 0; i < 100; i++)
+        v.push_back({ i, i * 2, i * 3 });
+    assert(v.size() == 100 && v.capacity() >= 100);
+    for (int i = 0; i < 100; i++)
+        assert(v[i].x == i && v[i].y == i * 2 && v[i].z == i * 3);
+
+    // Copies in both directions, shrinking and assigning to itself.
+    std::vector<point> copy(v);
+    assert(copy.size() == 100 && copy[99].z == 297);
+    std::static_vector<point, 8> fixed;
+    fixed.push_back({ 1, 2, 3 });
+    copy = fixed;
+    assert(copy.size() == 1 && copy[0].y == 2);
+    copy = copy;
+    assert(copy.size() == 1 && copy[0].z == 3);
+
+    std::monotonic_arena arena;
+    std::vector<point, std::monotonic_allocator<point>> in_arena{ std::monotonic_allocator<point>(arena) };
+    in_arena = std::move(v);
+    assert(in_arena.size() == 100 && in_arena[50].x == 50 && v.size() == 0);
+}
+
+void test_arena_ref_allocator()
+{
+    using arena_vector = std::vector<int, std::arena_ref_allocator<int>>;
+    // Only the buffer pointer is added. The MSVC ABI ignores [[no_unique_address]], so there the empty members take space.
+#ifdef _MSC_VER
+    static_assert(sizeof(arena_vector) <= sizeof(std::vector<int>) + sizeof(std::arena_ref_allocator<int>));
+#else
+    static_assert(sizeof(arena_vector) == sizeof(std::vector<int>) + sizeof(void*));
+#endif
+    static_assert(std::allocator_info::buffer_capacity<std::arena_ref_allocator<int>> == 0);
+
+    // A buffer sized at runtime, not aligned for int.
+    size_t bytes = 1 + 16 * sizeof(int);
+    std::unique_ptr<std::byte[]> storage(new std::byte[bytes + 1]);
+    std::arena_buffer buffer(storage.get() + 1, bytes);
+    std::arena_ref_allocator<int> alloc(buffer);
+    assert(std::allocator_info::buffer_capacity_of(alloc) == 15);
+
+    auto in_buffer = [&](const int* p) { return p >= (const int*)storage.get() && p < (const int*)(storage.get() + bytes + 1); };
+    arena_vector v(alloc);
+    for (int i = 0; i < 10; i++)
+        v.push_back(i);
+    assert(in_buffer(v.data()) && v.capacity() == 15 && buffer.in_use());
+
+    // The buffer is in use, so copies go to the heap.
+    arena_vector copy(v);
+    assert(!in_buffer(copy.data()) && copy[9] == 9);
+
+    // Moves between vectors of the same type take the block, also in the buffer.
+    const int* block = v.data();
+    arena_vector moved(std::move(v));
+    assert(moved.data() == block && v.size() == 0);
+    copy = std::move(moved);
+    assert(copy.data() == block && copy[5] == 5);
+
+    // Other vector types can't deallocate the buffer, so the elements are moved, but heap blocks are taken.
+    std::vector<int> heap(std::move(copy));
+    assert(heap.size() == 10 && !in_buffer(heap.data()) && copy.size() == 0);
+    for (int i = 0; i < 100; i++)
+        copy.push_back(i);
+    block = copy.data();
+    assert(!in_buffer(block) && !buffer.in_use());
+    heap = std::move(copy);
+    assert(heap.data() == block && heap[99] == 99);
+
+    // Growing out of the buffer releases it.
+    arena_vector growing(alloc);
+    for (int i = 0; i < 20; i++)
+        growing.push_back(i);
+    assert(!in_buffer(growing.data()) && growing[19] == 19 && !buffer.in_use());
+
+    // With a backing allocator which can't allocate the buffer is all there is.
+    std::arena_ref_allocator<int, std::throwing_allocator<int>> fixed_alloc(buffer);
+    std::vector<int, std::arena_ref_allocator<int, std::throwing_allocator<int>>> fixed(fixed_alloc);
+    for (int i = 0; i < 15; i++)
+        fixed.push_back(i);
+    bool threw = false;
+    try { fixed.push_back(15); } catch (const std::bad_alloc&) { threw = true; }
+    assert(threw && fixed.size() == 15);
+}
+
+void test_scratch_allocator()
+{
+    static_assert(std::allocator_info::deallocate_is_noop<std::scratch_allocator<int>>);
+    static_assert(std::allocator_info::deallocate_is_noop<std::buffered_allocator<int, 4, std::scratch_allocator<int>>>);
+
+    const int* first_block;
+    {
+        std::scratch_scope scope;
+        std::vector<int, std::scratch_allocator<int>> v;
+        v.reserve(1000);
+        first_block = v.data();
+        for (int i = 0; i < 1000; i++)
+            v.push_back(i);
+        assert(v[999] == 999 && v.data() == first_block);
+
+        {
+            std::scratch_scope inner;
+            std::sbo_vector<std::string, 2, std::scratch_allocator<std::string>> strings;
+            for (int i = 0; i < 10; i++)
+                strings.push_back(std::to_string(i));
+            assert(strings[9] == "9");
+
+            // v may not grow in here, but a copy belongs to the scope it is made in.
+            assert(v.get_allocator().depth() + 1 == std::scratch_allocator<int>().depth());
+            std::vector<int, std::scratch_allocator<int>> copy(v);
+            assert(copy.get_allocator().depth() == std::scratch_allocator<int>().depth());
+            copy.push_back(1000);
+
+            // Move assigning to v must not give it the block of this scope.
+            std::vector<int, std::scratch_allocator<int>> temp;
+            for (int i = 1; i <= 3; i++)
+                temp.push_back(i);
+            assert(!(temp.get_allocator() == v.get_allocator()));
+            v = std::move(temp);
+            assert(v.data() == first_block && v.size() == 3 && v[2] == 3);
+        }
+
+        // The inner scope gave back its memory, but not that of the outer scope.
+        std::vector<int, std::scratch_allocator<int>> after_inner;
+        after_inner.push_back(1);
+        assert(v[2] == 3 && after_inner.data() != v.data());
+    }
+
+    // The next scope starts where the first did.
+    std::scratch_scope scope;
+    std::vector<int, std::scratch_allocator<int>> v;
+    v.reserve(1000);
+    assert(v.data() == first_block);
+
+    // Each thread has its own arena.
+    std::thread([&] {
+        std::scratch_scope scope;
+        std::vector<int, std::scratch_allocator<int>> other;
+        other.reserve(1000);
+        assert(other.data() != first_block);
+    }).join();
+}
+
+void test_scoped_allocator()
+{
+    using inner = std::sbo_vector<int, 4, std::monotonic_allocator<int>>;
+    using scoped = std::scoped_allocator_adaptor<std::monotonic_allocator<inner>, std::monotonic_allocator<int>>;
+
+    std::monotonic_arena arena;
+    std::monotonic_allocator<int> alloc(arena);
+    std::vector<inner, scoped> outer{ scoped(alloc, alloc) };
+
+    std::monotonic_arena other_arena;
+    inner source{ std::monotonic_allocator<int>(other_arena) };
+    for (int i = 0; i < 10; i++)
+        source.push_back(i);
+
+    // The copies, and the moves when the outer vector grows, are constructed with the arena of the outer vector.
+    for (int i = 0; i < 20; i++)
+        outer.push_back(source);
+    outer.resize(30);
+    for (int i = 0; i < 30; i++)
+        assert(outer[i].get_allocator() == alloc);
+    assert(outer[19][9] == 9 && outer[29].size() == 0);
+    assert(!(source.get_allocator() == alloc));
+
+    // Moved with an equal allocator the spilled block is taken over.
+    const int* block = outer[0].data();
+    inner moved(std::move(outer[0]), alloc);
+    assert(moved.data() == block && outer[0].size() == 0);
+}
+
+template<typename V> concept releasable = requires(V& v) { v.release(); };
+template<typename V> concept adopts_untyped_pointer = requires(V& v, int* p) { v.adopt(p, 1, 1); };
+
+void test_release_adopt()
+{
+    std::vector<int> v;
+    for (int i = 0; i < 100; i++)
+        v.push_back(i);
+    const int* elements = v.data();
+
+    // The block is handed over without copying, also to and from an sbo_vector when it is spilled.
+    auto block = v.release();
+    assert(v.size() == 0 && v.capacity() == 0 && v.data() == nullptr);
+    assert(block.ptr == elements && block.size == 100 && block.capacity >= 100);
+    std::sbo_vector<int, 8> s;
+    s.push_back(1);
+    s.adopt(block);
+    assert(s.data() == elements && s.size() == 100 && s[99] == 99);
+    v.adopt(s.release());
+    assert(v.data() == elements && s.size() == 0);
+    v.push_back(100);
+    assert(v[100] == 100);
+
+    // Elements in the buffer are moved to a block from the backing allocator.
+    std::sbo_vector<std::string, 8> strings;
+    strings.push_back("a");
+    strings.push_back("b");
+    auto moved = strings.release();
+    assert(strings.size() == 0 && moved.size == 2 && moved.ptr != strings.data());
+    std::vector<std::string> adopted;
+    adopted.adopt(moved);
+    assert(adopted[0] == "a" && adopted[1] == "b");
+
+    // A block from a C API, here with std::allocator so that the vector can deallocate it.
+    int* raw = std::allocator<int>().allocate(16);
+    for (int i = 0; i < 4; i++)
+        raw[i] = i;
+    std::vector<int> from_raw;
+    from_raw.adopt<std::allocator<int>>(raw, 4, 16);
+    assert(from_raw.capacity() == 16 && from_raw[3] == 3);
+    static_assert(!adopts_untyped_pointer<std::vector<int>>);     // The allocator of a raw block has to be named.
+
+    // static_vector has no backing allocator to give its elements to.
+    static_assert(releasable<std::sbo_vector<int, 8>> && !releasable<std::static_vector<int, 8>>);
+}
+
+void test_streaming_copy()
+{
+    // All alignments and lengths around the vector size.
+    unsigned char src[200], dest[200];
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = (unsigned char)(i * 7 + 1);
+    for (size_t offset = 0; offset < 40; offset++) {
+        for (size_t bytes = 0; bytes < 100; bytes++) {
+            memset(dest, 0, sizeof(dest));
+            std::detail::__copy_streaming(dest + offset, src + 3, bytes);
+            assert(memcmp(dest + offset, src + 3, bytes) == 0 && dest[offset + bytes] == 0 && (offset == 0 || dest[offset - 1] == 0));
+        }
+    }
+
+    // Copies and growth of vectors above the threshold stream.
+    size_t previous = std::set_streaming_copy_threshold(1000);
+    std::vector<int> v;
+    for (int i = 0; i < 10000; i++)
+        v.push_back(i);
+    std::vector<int> copy(v);
+    v.resize(5000);
+    v = copy;
+    assert(v.size() == 10000 && v[0] == 0 && v[9999] == 9999);
+    std::set_streaming_copy_threshold(previous);
+}
+
+// Counts its live objects, and throws when copied with value -1.
+struct bulk_element {
+    static inline std::atomic<int> live{0};
+
+    bulk_element() { live++; }
+    bulk_element(const bulk_element& src) : value(src.value) {
+        if (value == -1)
+            throw value;
+        live++;
+    }
+    bulk_element(bulk_element&& src) noexcept : value(src.value) { live++; }
+    ~bulk_element() { live--; }
+    bulk_element& operator=(const bulk_element&) = default;
+
+    int value = 7;
+};
+
+template<> struct std::parallel_bulk_threshold<bulk_element, std::allocator<bulk_element>> : std::integral_constant<size_t, 1000> {};
+template<> struct std::parallel_bulk_threshold<uint16_t, std::allocator<uint16_t>> : std::integral_constant<size_t, 1000> {};
+
+void test_parallel_bulk()
+{
+    size_t previous = std::set_parallel_bulk_threads(4);
+    {
+        std::vector<bulk_element> v(100000);
+        assert(bulk_element::live == 100000 && v[0].value == 7 && v[99999].value == 7);
+        std::vector<bulk_element> copy(v);
+        assert(bulk_element::live == 200000 && copy[50000].value == 7);
+        v.reserve(300000);          // Relocated in parallel, as the move can't throw.
+        assert(bulk_element::live == 200000 && v[99999].value == 7);
+
+        // A copy that fails on one thread leaves no elements constructed by the others.
+        v[70000].value = -1;
+        std::vector<bulk_element> failed;
+        bool threw = false;
+        try {
+            failed = v;
+        }
+        catch (int) {
+            threw = true;
+        }
+        assert(threw && failed.size() == 0 && bulk_element::live == 200000);
+
+        // Trivial elements are cleared, copied and relocated in chunks.
+        std::vector<uint16_t> numbers(100000);
+        for (size_t i = 0; i < numbers.size(); i++) {
+            assert(numbers[i] == 0);
+            numbers[i] = uint16_t(i);
+        }
+        std::vector<uint16_t> numbers_copy(numbers);
+        numbers_copy.reserve(1000000);
+        assert(numbers_copy[12345] == 12345 && numbers_copy[99999] == uint16_t(99999));
+    }
+    assert(bulk_element::live == 0);
+    std::set_parallel_bulk_threads(previous);
+}
+
+#ifdef __linux__
+void test_mmap_allocator()
+{
+    static_assert(std::allocator_info::can_reallocate<std::mmap_allocator<int>>);
+
+    // Blocks are whole pages, and growth keeps the elements without vector copying them.
+    std::vector<int, std::mmap_allocator<int>> v;
+    v.push_back(0);
+    size_t page_elements = v.capacity();
+    assert(page_elements * sizeof(int) == size_t(sysconf(_SC_PAGESIZE)));
+    for (int i = 1; i < 100000; i++)
+        v.push_back(i);
+    v.reserve(10000000);
+    assert(v.capacity() >= 10000000 && v.size() == 100000);
+    for (int i = 0; i < 100000; i++)
+        assert(v[i] == i);
+
+    // Shrinking gives the pages back but keeps them mapped.
+    size_t capacity = v.capacity();
+    v.resize(10);
+    v.shrink_to_fit();
+    assert(v.capacity() == capacity && v[9] == 9);
+    v.resize(200000);
+    assert(v[9] == 9 && v[150000] == 0);
+
+    std::vector<int, std::mmap_allocator<int>> copy(v);
+    assert(copy.size() == 200000 && copy[5] == 5);
+
+    // Blocks of 2 MiB and more are aligned for huge pages, also when grown.
+    using huge_allocator = std::mmap_allocator<int, std::mmap_options::huge_pages | std::mmap_options::populate>;
+    std::sbo_vector<int, 16, huge_allocator> huge;
+    for (int i = 0; i < 100; i++)
+        huge.push_back(i);
+    huge.reserve(1000000);
+    assert(reinterpret_cast<uintptr_t>(huge.data()) % (2 << 20) == 0 && huge.capacity() * sizeof(int) % (2 << 20) == 0);
+    huge.reserve(3000000);
+    assert(reinterpret_cast<uintptr_t>(huge.data()) % (2 << 20) == 0 && huge[99] == 99);
+
+    // A value-initialized 1 GiB histogram is taken as fresh pages, which are not touched.
+    std::vector<uint32_t, std::mmap_allocator<uint32_t>> histogram(size_t(1) << 28);
+    assert(histogram.size() == size_t(1) << 28);
+    unsigned char resident = 1;
+    mincore(histogram.data() + (size_t(1) << 27), size_t(sysconf(_SC_PAGESIZE)), &resident);
+    assert((resident & 1) == 0 && histogram[size_t(1) << 27] == 0);
+
+    // Growing keeps the elements, and growing within the capacity clears memory that held other elements.
+    std::sbo_vector<int, 4, std::mmap_allocator<int>> small(3);
+    small[2] = 2;
+    small.resize(100000);
+    assert(small[2] == 2 && small[99999] == 0);
+    small[1] = 5;
+    small.resize(1);
+    small.resize(3);
+    assert(small[1] == 0);
+}
+#endif
 
 int main()
 {
@@ -60,4 +751,24 @@ int main()
     assert(v[2] == 3);
     assert(v[3] == 4);
     assert(v[4] == 5);
-}
\ No newline at end of file
+
+    test_buffered_node_allocator();
+    test_monotonic_allocator();
+    test_thread_caching_allocator();
+#ifdef P2667_HAS_PMR
+    test_pmr();
+#endif
+    test_stats_allocator();
+    test_sampling_allocator();
+    test_copy_and_move();
+    test_trivially_relocatable();
+    test_arena_ref_allocator();
+    test_scratch_allocator();
+    test_scoped_allocator();
+    test_release_adopt();
+    test_streaming_copy();
+    test_parallel_bulk();
+#ifdef __linux__
+    test_mmap_allocator();
+#endif
+}
@@ -0,0 +1,108 @@
+// The tracing mode changes vector, so it is tested in its own program. The trace is written to the file given as argument,
+// and replay_vector_trace is run on it as another test.
+#define P2667_TRACE_VECTORS
+#include "experimental_vector.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+using std::detail::__trace_op;
+
+// Ids are given as the order of creation in the trace, a = 1, b = 2 and c = 3, with 0 for the vector created before the
+// trace started.
+struct record {
+    __trace_op op;
+    uint64_t vector;
+    uint64_t operand;
+};
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "test_vector_trace.bin";
+
+    std::vector<int> before;
+    bool started = std::start_vector_trace(path);
+    assert(started);
+    {
+        std::vector<int> a;
+        a.reserve(4);
+        for (int i = 0; i < 10; i++)
+            a.push_back(i);     // The reserve of the growth is part of push_back.
+        a.resize(3);            // So are the pop_backs of resize.
+        a.pop_back();
+
+        std::vector<int> b(a);
+        std::sbo_vector<int, 8> c(std::move(b));        // Clears b.
+        a = c;
+        b = std::move(a);
+        c.clear();
+        before.push_back(1);
+    }
+    std::stop_vector_trace();
+    before.push_back(2);        // Not recorded, the trace is closed.
+
+    const record expected[] = {
+        { __trace_op::create, 1, sizeof(int) },
+        { __trace_op::reserve, 1, 4 },
+        { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 },
+        { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 },
+        { __trace_op::push_back, 1 }, { __trace_op::push_back, 1 },
+        { __trace_op::resize, 1, 3 },
+        { __trace_op::pop_back, 1 },
+        { __trace_op::copy_construct, 2, 1 },
+        { __trace_op::move_construct, 3, 2 },
+        { __trace_op::clear, 2 },
+        { __trace_op::copy_assign, 1, 3 },
+        { __trace_op::move_assign, 2, 1 },
+        { __trace_op::clear, 3 },
+        { __trace_op::push_back, 0 },
+        { __trace_op::destroy, 3 },
+        { __trace_op::destroy, 2 },
+        { __trace_op::destroy, 1 },
+    };
+    const size_t expected_count = sizeof(expected) / sizeof(expected[0]);
+
+    FILE* file = std::fopen(path, "rb");
+    assert(file != nullptr);
+    uint8_t data[1024];
+    size_t length = std::fread(data, 1, sizeof(data), file);
+    std::fclose(file);
+    assert(length > sizeof(std::detail::__trace_magic) && length < sizeof(data));
+    assert(std::memcmp(data, std::detail::__trace_magic, sizeof(std::detail::__trace_magic)) == 0);
+
+    // Translate the ids to the order of creation.
+    uint64_t ids[4] = {};
+    uint64_t created = 0;
+    auto vector_of = [&](uint64_t id) {
+        for (uint64_t i = 1; i <= created; i++) {
+            if (ids[i] == id)
+                return i;
+        }
+        return uint64_t(0);
+    };
+
+    const uint8_t* in = data + sizeof(std::detail::__trace_magic);
+    const uint8_t* end = data + length;
+    size_t count = 0;
+    while (in != end) {
+        __trace_op op = __trace_op(*in++);
+        uint64_t id = 0, operand = 0;
+        bool ok = std::detail::__get_varint(in, end, id) &&
+                  (!std::detail::__trace_has_operand(op) || std::detail::__get_varint(in, end, operand));
+        assert(ok);
+
+        if (op == __trace_op::create || op == __trace_op::copy_construct || op == __trace_op::move_construct)
+            ids[++created] = id;
+        if (op == __trace_op::copy_construct || op == __trace_op::move_construct || op == __trace_op::copy_assign ||
+            op == __trace_op::move_assign)
+            operand = vector_of(operand);
+
+        assert(count < expected_count);
+        assert(op == expected[count].op);
+        assert(vector_of(id) == expected[count].vector);
+        assert(operand == expected[count].operand);
+        count++;
+    }
+    assert(count == expected_count);
+}
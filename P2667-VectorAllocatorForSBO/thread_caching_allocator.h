@@ -0,0 +1,181 @@
+#pragma once
+
+/// Backing allocator which caches freed blocks in per-thread size class free lists, to keep sbo_vector spills away from
+/// the locks of the global heap. Blocks move between threads in batches through a shared pool, so a block allocated on
+/// one thread may be deallocated on another.
+
+#include "experimental_memory.h"
+
+#include <bit>
+#include <mutex>
+
+namespace std {
+namespace detail {
+
+struct __cache_block {
+    __cache_block* next;            // Next block in a free list or batch.
+    __cache_block* next_batch;      // Next batch in the shared pool, only used in the first block of each batch.
+};
+
+
+// Power of two size classes from 16 bytes to 32 kB. Larger blocks go directly to operator new.
+struct __size_classes {
+    static constexpr size_t min_size = 16;
+    static constexpr size_t max_size = 32768;
+    static constexpr size_t count = 12;
+
+    static constexpr size_t class_of(size_t bytes) { return bytes <= min_size ? 0 : bit_width(bytes - 1) - 4; }
+    static constexpr size_t size_of(size_t c) { return min_size << c; }
+    static constexpr size_t batch_size(size_t c) { return max<size_t>(2, 16384 / size_of(c)); }   // About 16 kB per batch
+};
+
+
+// The pool shared by all threads. It is never destroyed as thread caches may return blocks to it during program exit. The
+// slabs that blocks are carved from are never returned to the heap.
+class __shared_block_pool {
+public:
+    static __shared_block_pool& instance() {
+        static __shared_block_pool& pool = *new __shared_block_pool;
+        return pool;
+    }
+
+    __cache_block* get_batch(size_t c) {
+        {
+            lock_guard<mutex> lock(m_mutex[c]);
+            if (__cache_block* batch = m_batches[c]) {
+                m_batches[c] = batch->next_batch;
+                return batch;
+            }
+        }
+
+        return carve(c);
+    }
+
+    void put_batch(size_t c, __cache_block* batch) {
+        lock_guard<mutex> lock(m_mutex[c]);
+        batch->next_batch = m_batches[c];
+        m_batches[c] = batch;
+    }
+
+private:
+    // Carve one new batch out of a fresh slab.
+    static __cache_block* carve(size_t c) {
+        size_t size = __size_classes::size_of(c);
+        size_t count = __size_classes::batch_size(c);
+        byte* slab = static_cast<byte*>(::operator new(size * count));
+
+        for (size_t i = 0; i < count; i++)
+            reinterpret_cast<__cache_block*>(slab + i * size)->next = i + 1 < count ? reinterpret_cast<__cache_block*>(slab + (i + 1) * size) : nullptr;
+
+        return reinterpret_cast<__cache_block*>(slab);
+    }
+
+    mutex m_mutex[__size_classes::count];
+    __cache_block* m_batches[__size_classes::count] = {};
+};
+
+
+class __thread_block_cache {
+public:
+    ~__thread_block_cache() {
+        for (size_t c = 0; c < __size_classes::count; c++) {
+            while (m_free[c] != nullptr)
+                __shared_block_pool::instance().put_batch(c, take_batch(c, __size_classes::batch_size(c)));
+        }
+    }
+
+    void* allocate(size_t c) {
+        if (m_free[c] == nullptr) {
+            m_free[c] = __shared_block_pool::instance().get_batch(c);
+            for (__cache_block* b = m_free[c]; b != nullptr; b = b->next)
+                m_count[c]++;
+        }
+
+        __cache_block* b = m_free[c];
+        m_free[c] = b->next;
+        m_count[c]--;
+        return b;
+    }
+
+    // Keep at most two batches locally, hand one back when exceeded so another thread can pick it up.
+    void deallocate(void* p, size_t c) {
+        __cache_block* b = static_cast<__cache_block*>(p);
+        b->next = m_free[c];
+        m_free[c] = b;
+        if (++m_count[c] > 2 * __size_classes::batch_size(c))
+            __shared_block_pool::instance().put_batch(c, take_batch(c, __size_classes::batch_size(c)));
+    }
+
+private:
+    // Unlink at most count blocks from the front of the free list.
+    __cache_block* take_batch(size_t c, size_t count) {
+        __cache_block* first = m_free[c];
+        __cache_block* last = first;
+        for (size_t i = 1; i < count && last->next != nullptr; i++)
+            last = last->next;
+
+        m_free[c] = last->next;
+        last->next = nullptr;
+        for (__cache_block* b = first; b != nullptr; b = b->next)
+            m_count[c]--;
+
+        return first;
+    }
+
+    __cache_block* m_free[__size_classes::count] = {};
+    size_t m_count[__size_classes::count] = {};
+};
+
+inline thread_local __thread_block_cache __thread_cache;
+
+}  // namespace detail
+
+
+// Stateless allocator using the thread caches. allocate_at_least reports the full size class so a vector gets all of the
+// capacity of the block, and as vector deallocates with that capacity the block returns to the same size class.
+template<typename T> class thread_caching_allocator {
+    using classes = detail::__size_classes;
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using is_always_equal = true_type;
+
+    thread_caching_allocator() = default;
+    template<typename U> thread_caching_allocator(const thread_caching_allocator<U>&) {}
+
+    T* allocate(size_type count) { return allocate_at_least(count).ptr; }
+
+    allocation_result<T*> allocate_at_least(size_type count) {
+        if (count > max_size())
+            throw bad_array_new_length();
+
+        size_t bytes = count * sizeof(T);
+        if (!cached(bytes))
+            return { static_cast<T*>(::operator new(bytes)), count };
+
+        size_t c = classes::class_of(bytes);
+        return { static_cast<T*>(detail::__thread_cache.allocate(c)), classes::size_of(c) / sizeof(T) };
+    }
+
+    void deallocate(T* p, size_type count) {
+        if (p == nullptr)
+            return;
+
+        size_t bytes = count * sizeof(T);
+        if (!cached(bytes))
+            ::operator delete(p);
+        else
+            detail::__thread_cache.deallocate(p, classes::class_of(bytes));
+    }
+
+    static constexpr size_type max_size() { return size_type(-1) / sizeof(T); }
+
+    friend bool operator==(const thread_caching_allocator&, const thread_caching_allocator&) { return true; }
+
+private:
+    // Blocks are only aligned to the smallest size class.
+    static constexpr bool cached(size_t bytes) { return alignof(T) <= classes::min_size && bytes <= classes::max_size; }
+};
+
+}  // namespace std
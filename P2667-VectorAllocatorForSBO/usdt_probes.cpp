@@ -0,0 +1,18 @@
+// Instantiates every USDT probe site of vector and buffered_allocator, for check_usdt_probes.cmake to find in the notes
+// of the linked program. Run it under a tracer to see them fire:
+//
+//   bpftrace -e 'usdt:./usdt_probes:p2667:* { @[probe] = count(); }' -c ./usdt_probes
+
+#include "experimental_vector.h"
+
+int main()
+{
+    std::sbo_vector<int, 4> sbo;        // buffer_inline, buffer_spill and buffer_deallocate
+    for (int i = 0; i < 100; i++)
+        sbo.push_back(i);
+
+    std::vector<int> v;                 // vector_reserve
+    v.reserve(10);
+    v.reserve(100);
+    return sbo.size() + v.capacity() == 200 ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/// USDT probes in vector and buffered_allocator, for tracing growth and spills of running programs with bpftrace, perf or
+/// SystemTap. A probe is a test of its semaphore, a nop instruction and an ELF note, so it costs next to nothing when nothing
+/// is attached.
+/// They are compiled in when <sys/sdt.h> is available, define P2667_NO_USDT to leave them out. All probes are in the
+/// p2667 provider:
+///
+///   vector_reserve(element_size, old_capacity, new_capacity, allocator_type)      vector moved to a new block
+///   buffer_inline(element_size, count, buffer_capacity, allocator_type)           buffered_allocator handed out its buffer
+///   buffer_spill(element_size, count, allocated_count, allocator_type)            buffered_allocator used its Backing
+///   buffer_deallocate(element_size, count, was_inline, allocator_type)            buffered_allocator got a block back
+///
+/// allocator_type is the mangled type name, for instance: bpftrace -e 'usdt:./prog:p2667:buffer_spill { @[str(arg3)] = count(); }'
+
+#if !defined(P2667_NO_USDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#include <typeinfo>
+
+// Each probe gets a semaphore which the tracer increments while attached, so the arguments, such as the type name, are
+// only evaluated then. Defining _SDT_HAS_SEMAPHORES would give the probes of every provider in the translation unit a
+// semaphore, and theirs aren't defined here. Where <sys/sdt.h> was included without it, _SDT_SEMAPHORE is redefined to
+// give only the p2667 provider its semaphore and leave the note of every other provider as it was.
+#if defined(_SDT_HAS_SEMAPHORES)
+#define P2667_USDT_SEMAPHORES 1
+#elif defined(_SDT_SEMAPHORE) && defined(_SDT_ASM_1) && defined(_SDT_ASM_ADDR)
+#define _P2667_SDT_PROVIDER_p2667 ~, 1
+#define _P2667_SDT_SECOND(a, b, ...) b
+#define _P2667_SDT_IS_OWN_(...) _P2667_SDT_SECOND(__VA_ARGS__, 0, )
+#define _P2667_SDT_IS_OWN(provider) _P2667_SDT_IS_OWN_(_P2667_SDT_PROVIDER_##provider)
+#define _P2667_SDT_CAT_(a, b) a##b
+#define _P2667_SDT_CAT(a, b) _P2667_SDT_CAT_(a, b)
+#define _P2667_SDT_SEMAPHORE_0(provider, name) _SDT_ASM_1(_SDT_ASM_ADDR 0)
+#define _P2667_SDT_SEMAPHORE_1(provider, name) _SDT_ASM_1(_SDT_ASM_ADDR provider##_##name##_semaphore)
+#undef _SDT_SEMAPHORE
+#define _SDT_SEMAPHORE(provider, name) _P2667_SDT_CAT(_P2667_SDT_SEMAPHORE_, _P2667_SDT_IS_OWN(provider))(provider, name)
+#define P2667_USDT_SEMAPHORES 1
+#else
+// A <sys/sdt.h> without _SDT_SEMAPHORE: The probes have no semaphore and always evaluate their arguments.
+#define P2667_USDT_SEMAPHORES 0
+#endif
+
+#define P2667_PROBE_SEMAPHORE(name) inline unsigned short p2667_##name##_semaphore __attribute__((unused, section(".probes")))
+P2667_PROBE_SEMAPHORE(vector_reserve);
+P2667_PROBE_SEMAPHORE(buffer_inline);
+P2667_PROBE_SEMAPHORE(buffer_spill);
+P2667_PROBE_SEMAPHORE(buffer_deallocate);
+
+#define P2667_USDT 1
+#if P2667_USDT_SEMAPHORES
+#define P2667_PROBE_ENABLED(name) __builtin_expect(::p2667_##name##_semaphore != 0, 0)
+#else
+#define P2667_PROBE_ENABLED(name) true
+#endif
+#define P2667_PROBE4(name, a1, a2, a3, a4) do { if (P2667_PROBE_ENABLED(name)) DTRACE_PROBE4(p2667, name, a1, a2, a3, a4); } while (0)
+#define P2667_PROBE_TYPE(type) typeid(type).name()
+#else
+#define P2667_USDT 0
+#define P2667_PROBE_ENABLED(name) false
+#define P2667_PROBE4(name, a1, a2, a3, a4) ((void)0)
+#define P2667_PROBE_TYPE(type) nullptr
+#endif
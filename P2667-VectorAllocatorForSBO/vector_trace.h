@@ -0,0 +1,142 @@
+#pragma once
+
+/// Opt-in recorder of vector operations, to evaluate allocator configurations offline with the access patterns of a real
+/// program. Enable it by defining P2667_TRACE_VECTORS in all translation units, then set the environment variable
+/// P2667_VECTOR_TRACE to a file name or call start_vector_trace(). replay_vector_trace runs the trace against vector,
+/// sbo_vector of different SZ and arena backed vectors.
+///
+/// Each vector gets an id when it is constructed, and its construction, destruction, push_back, pop_back, reserve, resize,
+/// clear and assignments are written in the format of vector_trace_format.h. Operations which vector does by calling its
+/// own members, like resize calling push_back, are only recorded once. All threads write to one buffer under a mutex, so
+/// that the trace has a valid order even for vectors handed between threads, and so this is not for release builds.
+
+#include "vector_trace_format.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace std {
+namespace detail {
+
+class __trace_writer {
+public:
+    // Never destroyed, vectors with static storage duration may be destroyed after the trace is closed.
+    static __trace_writer& instance() {
+        static __trace_writer& writer = *new __trace_writer;
+        return writer;
+    }
+
+    bool start(const char* path) {
+        lock_guard<mutex> lock(m_mutex);
+        close_locked();
+        m_file = fopen(path, "wb");
+        if (m_file == nullptr)
+            return false;
+
+        fwrite(__trace_magic, 1, sizeof(__trace_magic), m_file);
+        return true;
+    }
+
+    void stop() {
+        lock_guard<mutex> lock(m_mutex);
+        close_locked();
+    }
+
+    void write(__trace_op op, uint64_t id, uint64_t operand) {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_file == nullptr)
+            return;
+
+        uint8_t* out = m_buffer + m_used;
+        *out++ = uint8_t(op);
+        out = __put_varint(out, id);
+        if (__trace_has_operand(op))
+            out = __put_varint(out, operand);
+        m_used = out - m_buffer;
+
+        if (m_used > sizeof(m_buffer) - __trace_max_record)
+            flush_locked();
+    }
+
+private:
+    __trace_writer() {
+        if (const char* path = getenv("P2667_VECTOR_TRACE"))
+            start(path);
+    }
+
+    void flush_locked() {
+        fwrite(m_buffer, 1, m_used, m_file);
+        m_used = 0;
+    }
+    void close_locked() {
+        if (m_file == nullptr)
+            return;
+
+        flush_locked();
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    mutex m_mutex;
+    FILE* m_file = nullptr;
+    size_t m_used = 0;
+    uint8_t m_buffer[65536];
+};
+
+
+// Member of each vector holding its id. record() returns a scope during which further operations on the same vector are not
+// recorded, as they are part of the one being recorded.
+class __vector_trace {
+public:
+    class scope {
+    public:
+        explicit scope(__vector_trace& trace) : m_trace(trace) {}
+        scope(const scope&) = delete;
+        ~scope() { m_trace.m_depth--; }
+
+    private:
+        __vector_trace& m_trace;
+    };
+
+    __vector_trace() : m_id(next_id()) {}
+    __vector_trace(const __vector_trace&) = delete;
+    __vector_trace& operator=(const __vector_trace&) = delete;
+
+    [[nodiscard]] scope record(__trace_op op, uint64_t operand = 0) {
+        if (m_depth++ == 0)
+            __trace_writer::instance().write(op, m_id, operand);
+        return scope(*this);
+    }
+
+    uint64_t id() const { return m_id; }
+
+private:
+    static uint64_t next_id() {
+        static atomic<uint64_t> next{1};
+        return next.fetch_add(1, memory_order_relaxed);
+    }
+
+    uint64_t m_id;
+    uint32_t m_depth = 0;
+};
+
+
+struct __trace_stop_at_exit {
+    ~__trace_stop_at_exit() { __trace_writer::instance().stop(); }
+};
+
+inline __trace_stop_at_exit __trace_stop_at_exit_instance;
+
+}  // namespace detail
+
+
+// Write the trace to path from now on, replacing any trace being written. Vectors constructed earlier get ids too, but as
+// their construction is not in the trace their operations are skipped by the replay. False if the file can't be created.
+inline bool start_vector_trace(const char* path) { return detail::__trace_writer::instance().start(path); }
+
+// Flush and close the trace. This also happens at exit.
+inline void stop_vector_trace() { detail::__trace_writer::instance().stop(); }
+
+}  // namespace std
@@ -0,0 +1,61 @@
+#pragma once
+
+/// Format of the vector operation traces written with P2667_TRACE_VECTORS (see vector_trace.h) and read by
+/// replay_vector_trace. A trace is the 8 byte magic followed by records of an operation byte, the id of the vector and, for
+/// the operations which have one, an operand, both LEB128 encoded. Ids are assigned in construction order and never reused.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace std {
+namespace detail {
+
+enum class __trace_op : uint8_t {
+    create,             // Operand: sizeof(T)
+    copy_construct,     // Operand: id of the source
+    move_construct,     // Operand: id of the source
+    destroy,
+    push_back,
+    pop_back,
+    reserve,            // Operand: requested capacity
+    resize,             // Operand: new size
+    clear,
+    copy_assign,        // Operand: id of the source
+    move_assign,        // Operand: id of the source
+    count
+};
+
+inline constexpr char __trace_magic[8] = { 'P', '2', '6', '6', '7', 'V', 'T', '1' };
+
+constexpr bool __trace_has_operand(__trace_op op) {
+    return op == __trace_op::create || op == __trace_op::copy_construct || op == __trace_op::move_construct ||
+           op == __trace_op::reserve || op == __trace_op::resize || op == __trace_op::copy_assign || op == __trace_op::move_assign;
+}
+
+// A record takes at most this many bytes.
+inline constexpr size_t __trace_max_record = 1 + 2 * 10;
+
+// Encode value at out and return the byte after it.
+inline uint8_t* __put_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+// Decode a value at in, advancing it. False if the value is truncated or too long.
+inline bool __get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; in != end && shift < 64; shift += 7) {
+        uint8_t b = *in++;
+        value |= uint64_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+}  // namespace detail
+}  // namespace std